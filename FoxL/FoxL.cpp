@@ -1,67 +1,139 @@
-#include "lexer.cpp"
-#include "parser.cpp"
-#include "interpreter.cpp"
-#include <iostream>
-#include <fstream>
-#include <string>
-#include <vector>
-#include <memory>
-
-const std::string VERSION = "0.0.3";
-
-void displayUsage(const char* programName) {
-    std::cout << "Usage: " << programName << " <file_name.foxl>\n";
-    std::cout << "Options:\n";
-    std::cout << "  --help      Display this help message\n";
-    std::cout << "  --version   Display the version information\n";
-}
-
-void displayVersion() {
-    std::cout << "FoxL Interpreter version: " << VERSION << std::endl;
-}
-
-int main(int argc, char* argv[]) {
-    if (argc < 2) {
-        displayUsage(argv[0]);
-        return 1;
-    }
-
-    std::string arg1 = argv[1];
-    if (arg1 == "--help") {
-        displayUsage(argv[0]);
-        return 0;
-    } else if (arg1 == "--version") {
-        displayVersion();
-        return 0;
-    }
-
-    std::ifstream file(arg1);
-    if (!file) {
-        std::cerr << "Error: Could not open file " << arg1 << std::endl;
-        return 1;
-    }
-
-    std::string input((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
-    file.close();
-
-    Lexer lexer(input);
-    Parser parser(lexer);
-
-    try {
-        std::vector<std::unique_ptr<Statement>> statements;
-        while (auto ast = parser.parse()) {
-            if (auto stmt = dynamic_cast<Statement*>(ast.get())) {
-                statements.push_back(std::unique_ptr<Statement>(stmt));
-                ast.release();
-            }
-        }
-
-        Interpreter interpreter(arg1);
-        interpreter.interpret(statements);
-    } catch (const std::exception& e) {
-        std::cerr << "Error: " << e.what() << std::endl;
-        return 1;
-    }
-
-    return 0;
-}
+#include "mappedfile.cpp"
+#include "inputstream.cpp"
+#include "symbols.cpp"
+#include "scan.cpp"
+#include "lexer.cpp"
+#include "arena.cpp"
+#include "parser.cpp"
+#include "flatast.cpp"
+#include "compilecache.cpp"
+#include "incremental.cpp"
+#include "modules.cpp"
+#include "typeinference.cpp"
+#include "resolver.cpp"
+#include "value.cpp"
+#include "persistence.cpp"
+#include "interpreter.cpp"
+#include "compiler.cpp"
+#include "vm.cpp"
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <memory>
+
+void displayUsage(const char* programName) {
+    std::cout << "Usage: " << programName << " [options] <file_name.foxl>\n";
+    std::cout << "       " << programName << " [options] -\n";
+    std::cout << "With - the script is read from standard input and each top-level statement runs as soon as\n";
+    std::cout << "the next one starts; its variables are saved to stdin.FoxLData.foxl.\n";
+    std::cout << "Options:\n";
+    std::cout << "  --help          Display this help message\n";
+    std::cout << "  --version       Display the version information\n";
+    std::cout << "  --engine=NAME   Select the execution engine: tree (default) or vm\n";
+    std::cout << "  --persist=WHEN  Write declared variables to the data file when a declaration happens\n";
+    std::cout << "                  at least MS milliseconds after the last write (interval:MS, default\n";
+    std::cout << "                  interval:100), every N declarations (count:N)\n";
+    std::cout << "                  or only on sync() and at exit (exit)\n";
+    std::cout << "  --reload-includes\n";
+    std::cout << "                  Run an included file again if it changed on disk since it last ran\n";
+    std::cout << "                  (by default each included file runs only once)\n";
+    std::cout << "  --lazy-functions\n";
+    std::cout << "                  Parse and compile a function body only when the function is first called\n";
+    std::cout << "                  (errors in a body are then reported at that call)\n";
+}
+
+void displayVersion() {
+    std::cout << "FoxL Interpreter version: " << VERSION << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        displayUsage(argv[0]);
+        return 1;
+    }
+
+    std::string engine = "tree";
+    std::string fileName;
+    PersistPolicy persistPolicy;
+    bool reloadIncludes = false;
+    bool lazyFunctions = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--help") {
+            displayUsage(argv[0]);
+            return 0;
+        } else if (arg == "--version") {
+            displayVersion();
+            return 0;
+        } else if (arg.rfind("--engine=", 0) == 0) {
+            engine = arg.substr(9);
+            if (engine != "tree" && engine != "vm") {
+                std::cerr << "Error: Unknown engine " << engine << std::endl;
+                return 1;
+            }
+        } else if (arg.rfind("--persist=", 0) == 0) {
+            try {
+                persistPolicy = PersistPolicy::parse(arg.substr(10));
+            } catch (const std::exception& e) {
+                std::cerr << "Error: " << e.what() << std::endl;
+                return 1;
+            }
+        } else if (arg == "--reload-includes") {
+            reloadIncludes = true;
+        } else if (arg == "--lazy-functions") {
+            lazyFunctions = true;
+        } else {
+            fileName = arg;
+        }
+    }
+
+    if (fileName.empty()) {
+        displayUsage(argv[0]);
+        return 1;
+    }
+
+    if (fileName == "-") {
+        // Nothing to cache or preload: the script does not exist as a whole until it has run.
+        try {
+            InputStream input;
+            Lexer lexer(input);
+            Interpreter interpreter("stdin", persistPolicy, reloadIncludes, lazyFunctions);
+            if (engine == "vm") {
+                VM vm(interpreter);
+                vm.runStream(lexer);
+            } else {
+                interpreter.interpretStream(lexer);
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    MappedFile file(fileName);
+    if (!file.isOpen()) {
+        std::cerr << "Error: Could not open file " << fileName << std::endl;
+        return 1;
+    }
+
+    try {
+        ParsedFile parsed = CompileCache::parse(fileName, file.view(), lazyFunctions);
+
+        Interpreter interpreter(fileName, persistPolicy, reloadIncludes, lazyFunctions);
+        interpreter.preloadIncludes(parsed);
+        if (engine == "vm") {
+            Compiler compiler;
+            VM vm(interpreter);
+            vm.run(compiler.compile(parsed.ast, parsed.statements));
+        } else {
+            interpreter.interpret(std::move(parsed));
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
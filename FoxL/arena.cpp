@@ -0,0 +1,123 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// A fixed-size list of pointers whose storage lives in an Arena. It is trivially destructible,
+// so nodes that hold one need no destructor.
+template <typename T>
+class NodeList {
+public:
+    NodeList() = default;
+    NodeList(T** items, uint32_t count) : items(items), count(count) {}
+
+    T** begin() const { return items; }
+    T** end() const { return items + count; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    T* operator[](size_t index) const { return items[index]; }
+
+private:
+    T** items = nullptr;
+    uint32_t count = 0;
+};
+
+// Bump-pointer allocator for everything one parse produces. Objects are carved out of a few
+// large blocks and are never freed one at a time; the arena releases its blocks all at once.
+// Objects that own heap memory of their own (parameter name lists) are the only ones
+// whose destructors are recorded and run before that.
+class Arena {
+public:
+    Arena() = default;
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+    Arena(Arena&&) = default;
+    Arena& operator=(Arena&&) = default;
+
+    ~Arena() {
+        for (auto it = destructors.rbegin(); it != destructors.rend(); ++it) {
+            it->destroy(it->object);
+        }
+    }
+
+    // Destroys everything allocated so far, keeping the most recent block for what comes next.
+    void reset() {
+        for (auto it = destructors.rbegin(); it != destructors.rend(); ++it) {
+            it->destroy(it->object);
+        }
+        destructors.clear();
+        if (blocks.empty()) {
+            return;
+        }
+        blocks.erase(blocks.begin(), blocks.end() - 1);
+        next = blocks.back().get();
+        remaining = lastBlockSize;
+    }
+
+    template <typename T, typename... Args>
+    T* make(Args&&... args) {
+        T* object = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        if constexpr (!std::is_trivially_destructible_v<T>) {
+            destructors.push_back({ object, [](void* pointer) { static_cast<T*>(pointer)->~T(); } });
+        }
+        return object;
+    }
+
+    template <typename T>
+    NodeList<T> list(const std::vector<T*>& items) {
+        if (items.empty()) {
+            return {};
+        }
+        auto** storage = static_cast<T**>(allocate(items.size() * sizeof(T*), alignof(T*)));
+        std::copy(items.begin(), items.end(), storage);
+        return NodeList<T>(storage, static_cast<uint32_t>(items.size()));
+    }
+
+    // A list of `count` null pointers for the caller to fill in through begin().
+    template <typename T>
+    NodeList<T> list(uint32_t count) {
+        if (count == 0) {
+            return {};
+        }
+        auto** storage = static_cast<T**>(allocate(count * sizeof(T*), alignof(T*)));
+        std::fill(storage, storage + count, nullptr);
+        return NodeList<T>(storage, count);
+    }
+
+private:
+    struct Destructor {
+        void* object;
+        void (*destroy)(void*);
+    };
+
+    static constexpr size_t FIRST_BLOCK_SIZE = 16 * 1024;
+    static constexpr size_t MAX_BLOCK_SIZE = 1024 * 1024;
+
+    std::vector<std::unique_ptr<char[]>> blocks;
+    std::vector<Destructor> destructors;
+    char* next = nullptr;
+    size_t remaining = 0;
+    size_t blockSize = FIRST_BLOCK_SIZE;
+    size_t lastBlockSize = 0;
+
+    void* allocate(size_t size, size_t alignment) {
+        size_t padding = (alignment - reinterpret_cast<uintptr_t>(next) % alignment) % alignment;
+        if (!next || padding + size > remaining) {
+            size_t newSize = std::max(blockSize, size + alignment);
+            blocks.push_back(std::unique_ptr<char[]>(new char[newSize]));
+            next = blocks.back().get();
+            remaining = newSize;
+            lastBlockSize = newSize;
+            blockSize = std::min(blockSize * 2, MAX_BLOCK_SIZE);
+            padding = (alignment - reinterpret_cast<uintptr_t>(next) % alignment) % alignment;
+        }
+        void* result = next + padding;
+        next += padding + size;
+        remaining -= padding + size;
+        return result;
+    }
+};
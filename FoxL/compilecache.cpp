@@ -0,0 +1,494 @@
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+const std::string VERSION = "0.0.3";
+
+// Parsed source files are cached next to the script as `<name>.foxlc`, so a script that has not
+// changed since its last run is not lexed or parsed again. The file holds an 8-byte magic, a u32
+// format version, the interpreter version, the size and a 64-bit hash of the source it was built
+// from, then the FlatAst as it comes from lowering, column by column: the node count and each
+// node column, then the children, the symbols, the parameter names, the function table and the
+// top-level statement IDs, every list prefixed with its u32 length, and last a 64-bit hash of
+// everything between the header and it. SymbolIds only mean something within one process, so the
+// file has its own list of the names and strings the tree uses, and symbol operands are indices
+// into that list. Loading is a check of that hash, a copy of each column, a check that every
+// reference is in range and points backwards, and interning the list to map those indices back
+// to SymbolIds. Resolver results are not stored; every run resolves the tree again. A function
+// body skipped in lazy mode is stored as its offset and line in the source, and the header
+// records which mode built the tree, so the two modes do not share a cache. Everything is in
+// host byte order.
+// FORMAT_VERSION has to change whenever the parser builds a different tree for the same source.
+class CompileCache {
+public:
+    static constexpr char MAGIC[8] = { 'F', 'o', 'x', 'L', 'A', 's', 't', '\0' };
+    static constexpr uint32_t FORMAT_VERSION = 6;
+
+    // Returns the tree of `fileName`, whose contents are `source`, from the cache when it
+    // matches and from the parser otherwise. A miss refreshes the cache; a cache that cannot be
+    // written is silently skipped. With `lazyFunctions`, function bodies point into `source`.
+    static ParsedFile parse(const std::string& fileName, std::string_view source, bool lazyFunctions = false) {
+        std::string cacheName = cacheFileName(fileName);
+        uint64_t hash = hashSource(source);
+
+        ParsedFile parsed;
+        if (load(cacheName, source, hash, lazyFunctions, parsed)) {
+            return parsed;
+        }
+
+        {
+            // Each statement is lowered as soon as it is parsed and its nodes are dropped, so
+            // the whole file never exists in both forms at once.
+            Lexer lexer(source);
+            StatementReader reader(lexer, parsed.ast, lazyFunctions);
+            NodeId statement;
+            while ((statement = reader.next()) != NO_NODE) {
+                parsed.statements.push_back(statement);
+            }
+        }
+        store(cacheName, source.size(), hash, lazyFunctions, parsed);
+        return parsed;
+    }
+
+    static std::string cacheFileName(const std::string& fileName) {
+        return fileName.substr(0, fileName.find_last_of('.')) + ".foxlc";
+    }
+
+private:
+    // Not a cryptographic hash; it only has to notice edits. Eight bytes per step keeps it far
+    // cheaper than lexing the same text.
+    static uint64_t hashSource(std::string_view source) {
+        constexpr uint64_t PRIME = 0x100000001b3ull;
+        uint64_t hash = 0xcbf29ce484222325ull ^ source.size();
+        size_t i = 0;
+        for (; i + sizeof(uint64_t) <= source.size(); i += sizeof(uint64_t)) {
+            uint64_t word;
+            std::memcpy(&word, source.data() + i, sizeof(word));
+            hash = (hash ^ word) * PRIME;
+            hash ^= hash >> 29;
+        }
+        for (; i < source.size(); ++i) {
+            hash = (hash ^ static_cast<unsigned char>(source[i])) * PRIME;
+        }
+        return hash;
+    }
+
+    static std::string header(uint64_t sourceSize, uint64_t hash, bool lazyFunctions) {
+        Writer out;
+        out.bytes.assign(MAGIC, sizeof(MAGIC));
+        out.raw(FORMAT_VERSION);
+        out.string(VERSION);
+        out.raw(sourceSize);
+        out.raw(hash);
+        out.raw(static_cast<uint8_t>(lazyFunctions));
+        return out.bytes;
+    }
+
+    static bool load(const std::string& cacheName, std::string_view source, uint64_t hash, bool lazyFunctions, ParsedFile& parsed) {
+        MappedFile file(cacheName);
+        std::string expected = header(source.size(), hash, lazyFunctions);
+        if (!file.isOpen() || file.size() < expected.size() + sizeof(uint64_t) ||
+            std::memcmp(file.data(), expected.data(), expected.size()) != 0) {
+            return false;
+        }
+        // Operands that are damaged but still in range would pass the Validator, so nothing is
+        // read from a payload that does not match its hash.
+        const char* payloadEnd = file.data() + file.size() - sizeof(uint64_t);
+        uint64_t payloadHash;
+        std::memcpy(&payloadHash, payloadEnd, sizeof(payloadHash));
+        if (hashSource(std::string_view(file.data() + expected.size(), payloadEnd - file.data() - expected.size())) != payloadHash) {
+            return false;
+        }
+
+        Reader in{ file.data() + expected.size(), payloadEnd };
+        FlatAst& ast = parsed.ast;
+        try {
+            uint32_t count = in.raw<uint32_t>();
+            in.column(ast.kinds, count);
+            in.column(ast.ops, count);
+            in.column(ast.flags, count);
+            in.column(ast.lines, count);
+            in.column(ast.a, count);
+            in.column(ast.b, count);
+            in.column(ast.c, count);
+            in.column(ast.children, in.raw<uint32_t>());
+            uint32_t symbolCount = in.raw<uint32_t>();
+            in.need(static_cast<size_t>(symbolCount) * sizeof(uint32_t)); // each has at least its length
+            std::vector<SymbolId> symbols(symbolCount);
+            for (SymbolId& symbol : symbols) {
+                symbol = Symbols::intern(in.string());
+            }
+            in.column(ast.parameterNames, in.raw<uint32_t>());
+            uint32_t functionCount = in.raw<uint32_t>();
+            for (uint32_t i = 0; i < functionCount; ++i) {
+                ast.functions.push_back(in.function(source));
+            }
+            in.column(parsed.statements, in.raw<uint32_t>());
+            if (in.position != in.end) {
+                throw std::runtime_error("Trailing bytes");
+            }
+            Validator{ ast, symbols.size() }.check(parsed.statements);
+            mapSymbols(ast, [&](uint32_t index) { return symbols[index]; });
+        } catch (const std::exception&) {
+            parsed = ParsedFile(); // a damaged cache is a miss
+            return false;
+        }
+        return true;
+    }
+
+    static void store(const std::string& cacheName, uint64_t sourceSize, uint64_t hash, bool lazyFunctions, const ParsedFile& parsed) {
+        // Written under a unique name and renamed into place, so a concurrent run never maps a
+        // half-written cache.
+        std::string tempName = cacheName + "." + std::to_string(std::random_device{}()) + ".tmp";
+        {
+            // The tree is written with its symbols renumbered in order of first use.
+            FlatAst renumbered;
+            renumbered.kinds = parsed.ast.kinds;
+            renumbered.a = parsed.ast.a;
+            renumbered.parameterNames = parsed.ast.parameterNames;
+            renumbered.functions = parsed.ast.functions;
+            std::vector<SymbolId> symbols;
+            std::unordered_map<SymbolId, uint32_t> indices;
+            mapSymbols(renumbered, [&](SymbolId symbol) {
+                auto [it, added] = indices.emplace(symbol, static_cast<uint32_t>(symbols.size()));
+                if (added) {
+                    symbols.push_back(symbol);
+                }
+                return it->second;
+            });
+
+            std::ofstream file(tempName, std::ios_base::binary | std::ios_base::trunc);
+            std::string headerBytes = header(sourceSize, hash, lazyFunctions);
+            size_t headerSize = headerBytes.size();
+            Writer out{ std::move(headerBytes), &file };
+            const FlatAst& ast = parsed.ast;
+            out.raw(static_cast<uint32_t>(ast.size()));
+            out.column(ast.kinds);
+            out.column(ast.ops);
+            out.column(ast.flags);
+            out.column(ast.lines);
+            out.column(renumbered.a);
+            out.column(ast.b);
+            out.column(ast.c);
+            out.raw(static_cast<uint32_t>(ast.children.size()));
+            out.column(ast.children);
+            out.raw(static_cast<uint32_t>(symbols.size()));
+            for (SymbolId symbol : symbols) {
+                out.string(Symbols::name(symbol));
+            }
+            out.raw(static_cast<uint32_t>(renumbered.parameterNames.size()));
+            out.column(renumbered.parameterNames);
+            out.raw(static_cast<uint32_t>(ast.functions.size()));
+            for (const auto& function : renumbered.functions) {
+                out.function(function);
+            }
+            out.raw(static_cast<uint32_t>(parsed.statements.size()));
+            out.column(parsed.statements);
+            out.flush();
+            file.close();
+            if (!file || !appendPayloadHash(tempName, headerSize)) {
+                std::error_code error;
+                std::filesystem::remove(tempName, error);
+                return;
+            }
+        }
+        std::error_code error;
+        std::filesystem::rename(tempName, cacheName, error);
+        if (error) {
+            std::filesystem::remove(tempName, error);
+        }
+    }
+
+    // Ends the file at `fileName` with the hash of everything after its header, which load()
+    // checks before it reads any of it.
+    static bool appendPayloadHash(const std::string& fileName, size_t headerSize) {
+        uint64_t payloadHash;
+        {
+            MappedFile written(fileName);
+            if (!written.isOpen() || written.size() < headerSize) {
+                return false;
+            }
+            payloadHash = hashSource(std::string_view(written.data() + headerSize, written.size() - headerSize));
+        }
+        std::ofstream file(fileName, std::ios_base::binary | std::ios_base::app);
+        file.write(reinterpret_cast<const char*>(&payloadHash), sizeof(payloadHash));
+        file.close();
+        return static_cast<bool>(file);
+    }
+
+    // Replaces every symbol operand of `ast`, and every function and parameter name, with
+    // map(operand). The loaded tree is mapped only after the Validator has checked it.
+    template <typename Map>
+    static void mapSymbols(FlatAst& ast, Map&& map) {
+        for (NodeId id = 0; id < ast.size(); ++id) {
+            switch (ast.kinds[id]) {
+                case NodeKind::VariableDeclaration:
+                case NodeKind::IncludeStatement:
+                case NodeKind::StringExpression:
+                case NodeKind::VariableExpression:
+                case NodeKind::FunctionCallExpression:
+                    ast.a[id] = map(ast.a[id]);
+                    break;
+                default:
+                    break;
+            }
+        }
+        for (FlatAst::Function& function : ast.functions) {
+            function.name = map(function.name);
+        }
+        for (SymbolId& name : ast.parameterNames) {
+            name = map(name);
+        }
+    }
+
+    // Collects bytes and, when given a file, hands them to it in pieces, so a large tree is
+    // never copied into one buffer; columns go to the file directly.
+    struct Writer {
+        static constexpr size_t BUFFER_SIZE = 64 * 1024;
+
+        std::string bytes;
+        std::ostream* file = nullptr;
+
+        void spill() {
+            if (bytes.size() >= BUFFER_SIZE) {
+                flush();
+            }
+        }
+
+        void flush() {
+            if (file) {
+                file->write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+                bytes.clear();
+            }
+        }
+
+        template <typename T>
+        void raw(const T& value) {
+            bytes.append(reinterpret_cast<const char*>(&value), sizeof(T));
+        }
+
+        template <typename T>
+        void column(const std::vector<T>& values) {
+            static_assert(std::is_trivially_copyable_v<T>);
+            flush();
+            file->write(reinterpret_cast<const char*>(values.data()), static_cast<std::streamsize>(values.size() * sizeof(T)));
+        }
+
+        void string(const std::string& text) {
+            raw(static_cast<uint32_t>(text.size()));
+            bytes += text;
+            spill();
+        }
+
+        void function(const FlatAst::Function& function) {
+            raw(function.name);
+            raw(function.parameters);
+            raw(function.parameterCount);
+            raw(function.body);
+            raw(function.bodyCount);
+            raw(static_cast<int32_t>(function.line));
+            raw(static_cast<uint8_t>(function.isLazy()));
+            if (function.isLazy()) {
+                raw(static_cast<uint64_t>(function.lazyOffset));
+                raw(static_cast<int32_t>(function.lazyLine));
+            }
+            spill();
+        }
+    };
+
+    // Copies columns out of the cache. Anything truncated throws, which load() turns into a miss.
+    struct Reader {
+        const char* position;
+        const char* end;
+
+        void need(size_t count) const {
+            if (static_cast<size_t>(end - position) < count) {
+                throw std::runtime_error("Truncated compile cache");
+            }
+        }
+
+        template <typename T>
+        T raw() {
+            need(sizeof(T));
+            T value;
+            std::memcpy(&value, position, sizeof(T));
+            position += sizeof(T);
+            return value;
+        }
+
+        template <typename T>
+        void column(std::vector<T>& values, uint32_t count) {
+            need(static_cast<size_t>(count) * sizeof(T));
+            values.resize(count);
+            if (count > 0) {
+                std::memcpy(values.data(), position, values.size() * sizeof(T));
+                position += values.size() * sizeof(T);
+            }
+        }
+
+        std::string_view string() {
+            uint32_t length = raw<uint32_t>();
+            need(length);
+            std::string_view text(position, length);
+            position += length;
+            return text;
+        }
+
+        FlatAst::Function function(std::string_view source) {
+            FlatAst::Function function;
+            function.name = raw<uint32_t>();
+            function.parameters = raw<uint32_t>();
+            function.parameterCount = raw<uint32_t>();
+            function.body = raw<uint32_t>();
+            function.bodyCount = raw<uint32_t>();
+            function.line = raw<int32_t>();
+            if (raw<uint8_t>() != 0) {
+                uint64_t bodyOffset = raw<uint64_t>();
+                function.lazyLine = raw<int32_t>();
+                if (bodyOffset == 0 || bodyOffset > source.size() || source[bodyOffset - 1] != '{') {
+                    throw std::runtime_error("Bad function body offset in compile cache");
+                }
+                function.lazySource = source;
+                function.lazyOffset = static_cast<size_t>(bodyOffset);
+            }
+            return function;
+        }
+    };
+
+    // Checks that a tree read from the cache is one lowering could have produced: kinds and
+    // operators in range, statements and expressions where each is expected, and every
+    // reference in bounds. Node operands have to point at smaller IDs, which rules out cycles.
+    struct Validator {
+        const FlatAst& ast;
+        size_t symbolCount;
+
+        static void fail() {
+            throw std::runtime_error("Malformed compile cache");
+        }
+
+        void symbol(uint32_t index) const {
+            if (index >= symbolCount) {
+                fail();
+            }
+        }
+
+        void node(NodeId id, NodeId parent, bool isStatement) const {
+            if (id >= parent || (ast.kinds[id] < NodeKind::NumberExpression) != isStatement) {
+                fail();
+            }
+        }
+
+        void optional(NodeId id, NodeId parent, bool isStatement) const {
+            if (id != NO_NODE) {
+                node(id, parent, isStatement);
+            }
+        }
+
+        void list(uint32_t first, uint32_t count, NodeId parent, bool isStatement) const {
+            if (first > ast.children.size() || count > ast.children.size() - first) {
+                fail();
+            }
+            for (uint32_t i = first; i < first + count; ++i) {
+                node(ast.children[i], parent, isStatement);
+            }
+        }
+
+        void function(uint32_t index, NodeId parent) const {
+            if (index >= ast.functions.size()) {
+                fail();
+            }
+            const FlatAst::Function& function = ast.functions[index];
+            symbol(function.name);
+            if (function.parameters > ast.parameterNames.size() || function.parameterCount > ast.parameterNames.size() - function.parameters) {
+                fail();
+            }
+            for (uint32_t i = function.parameters; i < function.parameters + function.parameterCount; ++i) {
+                symbol(ast.parameterNames[i]);
+            }
+            if (!function.isLazy()) {
+                list(function.body, function.bodyCount, parent, true);
+            }
+        }
+
+        void check(const std::vector<NodeId>& statements) const {
+            for (NodeId id = 0; id < ast.size(); ++id) {
+                if (ast.kinds[id] > NodeKind::IndexExpression || ast.ops[id] > Op::Decrement) {
+                    fail();
+                }
+                uint32_t a = ast.a[id], b = ast.b[id], c = ast.c[id];
+                switch (ast.kinds[id]) {
+                    case NodeKind::WriteStatement:
+                    case NodeKind::ExpressionStatement:
+                    case NodeKind::ReturnStatement:
+                        node(a, id, false);
+                        break;
+                    case NodeKind::VariableDeclaration:
+                        symbol(a);
+                        optional(b, id, false);
+                        break;
+                    case NodeKind::IfStatement:
+                        node(a, id, false);
+                        node(b, id, true);
+                        optional(c, id, true);
+                        break;
+                    case NodeKind::ForStatement:
+                        if (a > ast.children.size() || ast.children.size() - a < 4) {
+                            fail();
+                        }
+                        node(ast.children[a], id, true);
+                        node(ast.children[a + 1], id, false);
+                        node(ast.children[a + 2], id, true);
+                        node(ast.children[a + 3], id, true);
+                        break;
+                    case NodeKind::WhileStatement:
+                        node(a, id, false);
+                        node(b, id, true);
+                        break;
+                    case NodeKind::BlockStatement:
+                        list(a, b, id, true);
+                        break;
+                    case NodeKind::ArrayExpression:
+                        list(a, b, id, false);
+                        break;
+                    case NodeKind::IncludeStatement:
+                    case NodeKind::StringExpression:
+                    case NodeKind::VariableExpression:
+                        symbol(a);
+                        break;
+                    case NodeKind::FunctionDeclaration:
+                        function(a, id);
+                        break;
+                    case NodeKind::NumberExpression:
+                    case NodeKind::BoolExpression:
+                        break;
+                    case NodeKind::BinaryExpression:
+                    case NodeKind::IndexExpression:
+                        node(a, id, false);
+                        node(b, id, false);
+                        break;
+                    case NodeKind::UnaryExpression:
+                        node(a, id, false);
+                        break;
+                    case NodeKind::FunctionCallExpression:
+                        symbol(a);
+                        list(b, c, id, false);
+                        break;
+                    case NodeKind::ReadExpression:
+                        optional(a, id, false);
+                        break;
+                }
+            }
+            for (NodeId id : statements) {
+                node(id, static_cast<NodeId>(ast.size()), true);
+            }
+        }
+    };
+};
@@ -0,0 +1,609 @@
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+enum class OpCode : uint8_t {
+    Constant,       // u16 constant index
+    Pop,
+    DefineGlobal,   // u16 name index, u8 isConstant
+    GetGlobal,      // u16 name index
+    SetGlobal,      // u16 name index
+    GetLocal,       // u16 slot
+    SetLocal,       // u16 slot
+    GetIndex,
+    SetIndex,       // u16 name index
+    SetIndexLocal,  // u16 slot
+    Increment,      // u16 name index
+    Decrement,      // u16 name index
+    IncrementLocal, // u16 slot, u16 name index
+    DecrementLocal, // u16 slot, u16 name index
+    Add,
+    Subtract,
+    Multiply,
+    Divide,
+    Power,
+    Negate,
+    Not,
+    Less,
+    Greater,
+    LessEqual,
+    GreaterEqual,
+    Equal,
+    NotEqual,
+    AddInt,         // operands known to be ints; see TypeInference
+    SubtractInt,
+    MultiplyInt,
+    DivideInt,
+    LessInt,
+    GreaterInt,
+    LessEqualInt,
+    GreaterEqualInt,
+    EqualInt,
+    NotEqualInt,
+    AddDouble,      // operands known to be doubles
+    SubtractDouble,
+    MultiplyDouble,
+    DivideDouble,
+    LessDouble,
+    GreaterDouble,
+    LessEqualDouble,
+    GreaterEqualDouble,
+    EqualDouble,
+    NotEqualDouble,
+    Array,          // u16 element count
+    Read,           // u8 hasPrompt
+    Write,
+    Jump,           // u16 forward offset
+    JumpIfFalse,    // u16 forward offset
+    Loop,           // u16 backward offset
+    DefineFunction, // u16 function index
+    Call,           // u16 name index, u8 argument count
+    Return,
+    Include,        // u16 constant index of the file name
+    Fail,           // u16 constant index of the error message
+    // Superinstructions for the commonest sequences in loops; see Compiler.
+    AddLocalConstant,      // u16 slot, u16 constant index: `x = x + constant;`
+    StepLocal,             // u16 slot, u16 name index, u8 isIncrement: `x++;` or `x--;`
+    JumpIfNotLess,         // u16 forward offset, like Less and JumpIfFalse
+    JumpIfNotGreater,      // u16 forward offset
+    JumpIfNotLessEqual,    // u16 forward offset
+    JumpIfNotGreaterEqual  // u16 forward offset
+};
+
+// Bytecode range of a single statement. A runtime error inside it is reported and
+// execution resumes at `end`, which mirrors the per-statement recovery in Interpreter::execute.
+struct StatementRange {
+    uint32_t start;
+    uint32_t end;
+};
+
+struct Chunk {
+    std::vector<uint8_t> code;
+    std::vector<int> lines;
+    std::vector<Value> constants;
+    std::vector<StatementRange> statements;
+
+    void write(uint8_t byte, int line) {
+        code.push_back(byte);
+        lines.push_back(line);
+    }
+};
+
+struct FunctionProto {
+    SymbolId name = 0;
+    std::vector<uint16_t> parameters; // name indices
+    uint16_t slotCount = 0;           // parameters first, then locals
+    Chunk chunk;
+    FlatAst* lazyAst = nullptr;       // set, with lazyFunction, until a lazily parsed body is compiled
+    uint32_t lazyFunction = 0;
+};
+
+struct Program {
+    std::vector<SymbolId> names;
+    std::vector<std::unique_ptr<FunctionProto>> functions;
+    FunctionProto script;
+};
+
+class Compiler {
+public:
+    std::unique_ptr<Program> compile(FlatAst& tree, const std::vector<NodeId>& statements) {
+        auto compiled = std::make_unique<Program>();
+        program = compiled.get();
+        program->script.name = Symbols::intern("<script>");
+        program->script.slotCount = checkSlotCount(resolver.resolve(tree, statements), 1);
+        current = &program->script;
+        ast = &tree;
+
+        int line = 1;
+        for (NodeId statement : statements) {
+            compileStatement(statement);
+            line = ast->lines[statement];
+        }
+        emitReturnDefault(line);
+
+        return compiled;
+    }
+
+    // Parses and compiles the body of `function`, a lazy function of `target`, in place. Its
+    // names and nested functions are appended to `target`, so indices in use stay valid.
+    void compileLazyFunction(Program& target, FunctionProto& function) {
+        FlatAst& tree = *function.lazyAst;
+        FlatAstBuilder(tree).parseLazyBody(function.lazyFunction);
+        resolver.resolveFunction(tree, function.lazyFunction);
+
+        program = &target;
+        ast = &tree;
+        for (size_t i = 0; i < target.names.size(); ++i) {
+            nameIndices[target.names[i]] = static_cast<uint16_t>(i);
+        }
+        const FlatAst::Function& entry = tree.functions[function.lazyFunction];
+        function.slotCount = checkSlotCount(entry.slotCount, entry.line);
+        function.chunk = Chunk();
+        compileBody(function, function.lazyFunction);
+        function.lazyAst = nullptr;
+    }
+
+private:
+    Program* program = nullptr;
+    FunctionProto* current = nullptr;
+    FlatAst* ast = nullptr;
+    std::unordered_map<SymbolId, uint16_t> nameIndices;
+    Resolver resolver;
+
+    uint16_t checkSlotCount(int slotCount, int line) {
+        if (slotCount > UINT16_MAX) {
+            throw std::runtime_error("Too many local variables in one function at line " + std::to_string(line));
+        }
+        return static_cast<uint16_t>(slotCount);
+    }
+
+    Chunk& chunk() {
+        return current->chunk;
+    }
+
+    void emit(OpCode op, int line) {
+        chunk().write(static_cast<uint8_t>(op), line);
+    }
+
+    void emitByte(uint8_t byte, int line) {
+        chunk().write(byte, line);
+    }
+
+    void emitShort(uint16_t value, int line) {
+        chunk().write(static_cast<uint8_t>(value & 0xff), line);
+        chunk().write(static_cast<uint8_t>(value >> 8), line);
+    }
+
+    void emitReturnDefault(int line) {
+        emitConstant(0, line);
+        emit(OpCode::Return, line);
+    }
+
+    uint16_t makeConstant(Value value, int line) {
+        if (chunk().constants.size() > UINT16_MAX) {
+            throw std::runtime_error("Too many constants in one chunk at line " + std::to_string(line));
+        }
+        chunk().constants.push_back(std::move(value));
+        return static_cast<uint16_t>(chunk().constants.size() - 1);
+    }
+
+    // For a statement the tree engine rejects only when it runs it: the error is raised at the
+    // same point, inside the statement, so the VM reports that statement and carries on.
+    void emitFailure(const std::string& message, int line) {
+        uint16_t index = makeConstant(message, line);
+        emit(OpCode::Fail, line);
+        emitShort(index, line);
+    }
+
+    void emitConstant(Value value, int line) {
+        uint16_t index = makeConstant(std::move(value), line);
+        emit(OpCode::Constant, line);
+        emitShort(index, line);
+    }
+
+    uint16_t nameIndex(SymbolId name) {
+        auto it = nameIndices.find(name);
+        if (it != nameIndices.end()) {
+            return it->second;
+        }
+        if (program->names.size() > UINT16_MAX) {
+            throw std::runtime_error("Too many distinct names in one program");
+        }
+        program->names.push_back(name);
+        uint16_t index = static_cast<uint16_t>(program->names.size() - 1);
+        nameIndices[name] = index;
+        return index;
+    }
+
+    bool isLocal(NodeId id) const {
+        return (ast->flags[id] & FlatAst::IS_LOCAL) != 0;
+    }
+
+    size_t emitJump(OpCode op, int line) {
+        emit(op, line);
+        emitShort(0xffff, line);
+        return chunk().code.size() - 2;
+    }
+
+    void patchJump(size_t offset, int line) {
+        size_t jump = chunk().code.size() - offset - 2;
+        if (jump > UINT16_MAX) {
+            throw std::runtime_error("Too much code to jump over at line " + std::to_string(line));
+        }
+        chunk().code[offset] = static_cast<uint8_t>(jump & 0xff);
+        chunk().code[offset + 1] = static_cast<uint8_t>(jump >> 8);
+    }
+
+    void emitLoop(size_t loopStart, int line) {
+        emit(OpCode::Loop, line);
+        size_t offset = chunk().code.size() - loopStart + 2;
+        if (offset > UINT16_MAX) {
+            throw std::runtime_error("Loop body too large at line " + std::to_string(line));
+        }
+        emitShort(static_cast<uint16_t>(offset), line);
+    }
+
+    void compileStatement(NodeId statement) {
+        if (statement == NO_NODE) {
+            return;
+        }
+        uint32_t start = static_cast<uint32_t>(chunk().code.size());
+        compileStatementBody(statement);
+        chunk().statements.push_back({ start, static_cast<uint32_t>(chunk().code.size()) });
+    }
+
+    void compileStatementBody(NodeId statement) {
+        int line = ast->lines[statement];
+        uint32_t a = ast->a[statement];
+        uint32_t b = ast->b[statement];
+        uint32_t c = ast->c[statement];
+
+        switch (ast->kinds[statement]) {
+            case NodeKind::WriteStatement:
+                compileExpression(a);
+                emit(OpCode::Write, line);
+                break;
+            case NodeKind::VariableDeclaration:
+                if (b != NO_NODE) {
+                    compileExpression(b);
+                } else {
+                    emitConstant(0, line);
+                }
+                if (isLocal(statement)) {
+                    emit(OpCode::SetLocal, line);
+                    emitShort(static_cast<uint16_t>(c), line);
+                    emit(OpCode::Pop, line);
+                } else {
+                    emit(OpCode::DefineGlobal, line);
+                    emitShort(nameIndex(a), line);
+                    emitByte((ast->flags[statement] & FlatAst::IS_CONSTANT) ? 1 : 0, line);
+                }
+                break;
+            case NodeKind::ExpressionStatement:
+                if (!compileLocalUpdate(a, line)) {
+                    compileExpression(a);
+                    emit(OpCode::Pop, line);
+                }
+                break;
+            case NodeKind::FunctionDeclaration:
+                compileFunction(a);
+                break;
+            case NodeKind::IfStatement: {
+                size_t elseJump = compileCondition(a, line);
+                compileStatement(b);
+                if (c != NO_NODE) {
+                    size_t endJump = emitJump(OpCode::Jump, line);
+                    patchJump(elseJump, line);
+                    compileStatement(c);
+                    patchJump(endJump, line);
+                } else {
+                    patchJump(elseJump, line);
+                }
+                break;
+            }
+            case NodeKind::ForStatement: {
+                NodeId initializer = ast->children[a], condition = ast->children[a + 1];
+                NodeId increment = ast->children[a + 2], body = ast->children[a + 3];
+                compileStatement(initializer);
+                size_t loopStart = chunk().code.size();
+                size_t exitJump = compileCondition(condition, line);
+                compileStatement(body);
+                compileStatement(increment);
+                emitLoop(loopStart, line);
+                patchJump(exitJump, line);
+                break;
+            }
+            case NodeKind::WhileStatement: {
+                size_t loopStart = chunk().code.size();
+                size_t exitJump = compileCondition(a, line);
+                compileStatement(b);
+                emitLoop(loopStart, line);
+                patchJump(exitJump, line);
+                break;
+            }
+            case NodeKind::ReturnStatement:
+                compileExpression(a);
+                emit(OpCode::Return, line);
+                break;
+            case NodeKind::BlockStatement:
+                for (uint32_t i = 0; i < b; ++i) {
+                    compileStatement(ast->children[a + i]);
+                }
+                break;
+            case NodeKind::IncludeStatement:
+                emit(OpCode::Include, line);
+                emitShort(makeConstant(Symbols::name(a), line), line);
+                emit(OpCode::Pop, line);
+                break;
+            default:
+                emitFailure("Unsupported statement at line " + std::to_string(line), line);
+        }
+    }
+
+    // Compiles the condition of an `if` or a loop and a jump past what it guards, which is
+    // returned for patchJump(). A comparison jumps on its own result without pushing it.
+    size_t compileCondition(NodeId condition, int line) {
+        OpCode jump = OpCode::JumpIfFalse;
+        if (ast->kinds[condition] == NodeKind::BinaryExpression) {
+            switch (ast->ops[condition]) {
+                case Op::Less: jump = OpCode::JumpIfNotLess; break;
+                case Op::Greater: jump = OpCode::JumpIfNotGreater; break;
+                case Op::LessEqual: jump = OpCode::JumpIfNotLessEqual; break;
+                case Op::GreaterEqual: jump = OpCode::JumpIfNotGreaterEqual; break;
+                default: break;
+            }
+        }
+        if (jump == OpCode::JumpIfFalse) {
+            compileExpression(condition);
+        } else {
+            compileExpression(ast->a[condition]);
+            compileExpression(ast->b[condition]);
+        }
+        return emitJump(jump, line);
+    }
+
+    // Compiles `x = x + constant;` and `x++;` or `x--;` on a local `x` as single instructions,
+    // since they make up most loop increments. Returns false for any other expression.
+    bool compileLocalUpdate(NodeId expr, int line) {
+        NodeKind kind = ast->kinds[expr];
+        Op op = ast->ops[expr];
+        bool step = kind == NodeKind::UnaryExpression && (op == Op::Increment || op == Op::Decrement);
+        if (!step && !(kind == NodeKind::BinaryExpression && op == Op::Assign)) {
+            return false; // `a` need not be a node, e.g. for a call
+        }
+        NodeId target = ast->a[expr];
+        if (ast->kinds[target] != NodeKind::VariableExpression || !isLocal(target)) {
+            return false;
+        }
+        uint16_t slot = static_cast<uint16_t>(ast->b[target]);
+        if (step) {
+            emit(OpCode::StepLocal, line);
+            emitShort(slot, line);
+            emitShort(nameIndex(ast->a[target]), line);
+            emitByte(op == Op::Increment ? 1 : 0, line);
+            return true;
+        }
+        NodeId sum = ast->b[expr];
+        if (ast->kinds[sum] != NodeKind::BinaryExpression || ast->ops[sum] != Op::Add) {
+            return false;
+        }
+        NodeId left = ast->a[sum], right = ast->b[sum];
+        if (ast->kinds[left] != NodeKind::VariableExpression || !isLocal(left) || ast->b[left] != slot ||
+            ast->kinds[right] != NodeKind::NumberExpression) {
+            return false;
+        }
+        Value constant = (ast->flags[right] & FlatAst::IS_DOUBLE) ? Value(ast->doubleValue(right)) : Value(static_cast<int>(ast->a[right]));
+        emit(OpCode::AddLocalConstant, line);
+        emitShort(slot, line);
+        emitShort(makeConstant(std::move(constant), line), line);
+        return true;
+    }
+
+    void compileBody(FunctionProto& function, uint32_t index) {
+        FunctionProto* enclosing = current;
+        current = &function;
+        const FlatAst::Function& entry = ast->functions[index];
+        uint32_t body = entry.body, bodyCount = entry.bodyCount;
+        int lastLine = entry.line;
+        for (uint32_t i = 0; i < bodyCount; ++i) {
+            NodeId stmt = ast->children[body + i];
+            compileStatement(stmt);
+            lastLine = ast->lines[stmt];
+        }
+        emitReturnDefault(lastLine);
+        current = enclosing;
+    }
+
+    void compileFunction(uint32_t index) {
+        const FlatAst::Function& entry = ast->functions[index];
+        int line = entry.line;
+        if (program->functions.size() > UINT16_MAX) {
+            throw std::runtime_error("Too many functions in one program at line " + std::to_string(line));
+        }
+
+        auto function = std::make_unique<FunctionProto>();
+        function->name = entry.name;
+        for (uint32_t i = 0; i < entry.parameterCount; ++i) {
+            function->parameters.push_back(nameIndex(ast->parameterNames[entry.parameters + i]));
+        }
+        if (entry.isLazy()) {
+            function->lazyAst = ast;
+            function->lazyFunction = index;
+        } else {
+            function->slotCount = checkSlotCount(entry.slotCount, line);
+            compileBody(*function, index);
+        }
+
+        program->functions.push_back(std::move(function));
+        emit(OpCode::DefineFunction, line);
+        emitShort(static_cast<uint16_t>(program->functions.size() - 1), line);
+    }
+
+    void compileExpression(NodeId expr) {
+        int line = ast->lines[expr];
+        uint32_t a = ast->a[expr];
+        uint32_t b = ast->b[expr];
+        Op op = ast->ops[expr];
+
+        switch (ast->kinds[expr]) {
+            case NodeKind::NumberExpression:
+                if (ast->flags[expr] & FlatAst::IS_DOUBLE) {
+                    emitConstant(ast->doubleValue(expr), line);
+                } else {
+                    emitConstant(static_cast<int>(a), line);
+                }
+                break;
+            case NodeKind::StringExpression:
+                emitConstant(Symbols::name(a), line);
+                break;
+            case NodeKind::BoolExpression:
+                emitConstant(a != 0, line);
+                break;
+            case NodeKind::VariableExpression:
+                if (isLocal(expr)) {
+                    emit(OpCode::GetLocal, line);
+                    emitShort(static_cast<uint16_t>(b), line);
+                } else {
+                    emit(OpCode::GetGlobal, line);
+                    emitShort(nameIndex(a), line);
+                }
+                break;
+            case NodeKind::BinaryExpression:
+                compileBinary(expr);
+                break;
+            case NodeKind::UnaryExpression: {
+                if (op == Op::Subtract || op == Op::Not) {
+                    compileExpression(a);
+                    emit(op == Op::Subtract ? OpCode::Negate : OpCode::Not, line);
+                    break;
+                }
+                NodeId target = a;
+                if (ast->kinds[target] != NodeKind::VariableExpression || (op != Op::Increment && op != Op::Decrement)) {
+                    emitFailure(std::string("Unsupported unary operator: ") + opName(op) + " at line " + std::to_string(line), line);
+                    break;
+                }
+                if (isLocal(target)) {
+                    emit(op == Op::Increment ? OpCode::IncrementLocal : OpCode::DecrementLocal, line);
+                    emitShort(static_cast<uint16_t>(ast->b[target]), line);
+                } else {
+                    emit(op == Op::Increment ? OpCode::Increment : OpCode::Decrement, line);
+                }
+                emitShort(nameIndex(ast->a[target]), line);
+                if (ast->flags[expr] & FlatAst::IS_PREFIX) {
+                    // The step pushes the old value; a prefix step yields the new one instead.
+                    emit(OpCode::Pop, line);
+                    compileExpression(target);
+                }
+                break;
+            }
+            case NodeKind::ReadExpression:
+                if (a != NO_NODE) {
+                    compileExpression(a);
+                }
+                emit(OpCode::Read, line);
+                emitByte(a != NO_NODE ? 1 : 0, line);
+                break;
+            case NodeKind::IndexExpression:
+                compileExpression(a);
+                compileExpression(b);
+                emit(OpCode::GetIndex, line);
+                break;
+            case NodeKind::ArrayExpression:
+                if (b > UINT16_MAX) {
+                    throw std::runtime_error("Too many array elements at line " + std::to_string(line));
+                }
+                for (uint32_t i = 0; i < b; ++i) {
+                    compileExpression(ast->children[a + i]);
+                }
+                emit(OpCode::Array, line);
+                emitShort(static_cast<uint16_t>(b), line);
+                break;
+            case NodeKind::FunctionCallExpression: {
+                uint32_t count = ast->c[expr];
+                if (count > UINT8_MAX) {
+                    throw std::runtime_error("Too many arguments at line " + std::to_string(line));
+                }
+                for (uint32_t i = 0; i < count; ++i) {
+                    compileExpression(ast->children[b + i]);
+                }
+                emit(OpCode::Call, line);
+                emitShort(nameIndex(a), line);
+                emitByte(static_cast<uint8_t>(count), line);
+                break;
+            }
+            default:
+                emitFailure("Unsupported expression type at line " + std::to_string(line), line);
+        }
+    }
+
+    void compileBinary(NodeId expr) {
+        int line = ast->lines[expr];
+        Op op = ast->ops[expr];
+        NodeId left = ast->a[expr];
+        NodeId right = ast->b[expr];
+
+        if (op == Op::Assign) {
+            if (ast->kinds[left] == NodeKind::IndexExpression) {
+                NodeId target = ast->a[left];
+                compileExpression(right);
+                if (ast->kinds[target] != NodeKind::VariableExpression) {
+                    emitFailure("Invalid assignment target at line " + std::to_string(line), line);
+                    return;
+                }
+                compileExpression(ast->b[left]);
+                if (isLocal(target)) {
+                    emit(OpCode::SetIndexLocal, line);
+                    emitShort(static_cast<uint16_t>(ast->b[target]), line);
+                } else {
+                    emit(OpCode::SetIndex, line);
+                    emitShort(nameIndex(ast->a[target]), line);
+                }
+                return;
+            }
+            compileExpression(right);
+            if (ast->kinds[left] != NodeKind::VariableExpression) {
+                emitFailure("Invalid assignment target at line " + std::to_string(line), line);
+                return;
+            }
+            if (isLocal(left)) {
+                emit(OpCode::SetLocal, line);
+                emitShort(static_cast<uint16_t>(ast->b[left]), line);
+            } else {
+                emit(OpCode::SetGlobal, line);
+                emitShort(nameIndex(ast->a[left]), line);
+            }
+            return;
+        }
+
+        // Picks the generic instruction, or the int or double one when the operand types are known.
+        uint8_t flags = ast->flags[expr];
+        auto pick = [flags](OpCode generic, OpCode ints, OpCode doubles) {
+            return (flags & FlatAst::INT_OPERANDS) ? ints : (flags & FlatAst::DOUBLE_OPERANDS) ? doubles : generic;
+        };
+        OpCode opCode;
+        switch (op) {
+            case Op::Add: opCode = pick(OpCode::Add, OpCode::AddInt, OpCode::AddDouble); break;
+            case Op::Subtract: opCode = pick(OpCode::Subtract, OpCode::SubtractInt, OpCode::SubtractDouble); break;
+            case Op::Multiply: opCode = pick(OpCode::Multiply, OpCode::MultiplyInt, OpCode::MultiplyDouble); break;
+            case Op::Divide: opCode = pick(OpCode::Divide, OpCode::DivideInt, OpCode::DivideDouble); break;
+            case Op::Less: opCode = pick(OpCode::Less, OpCode::LessInt, OpCode::LessDouble); break;
+            case Op::Greater: opCode = pick(OpCode::Greater, OpCode::GreaterInt, OpCode::GreaterDouble); break;
+            case Op::LessEqual: opCode = pick(OpCode::LessEqual, OpCode::LessEqualInt, OpCode::LessEqualDouble); break;
+            case Op::GreaterEqual: opCode = pick(OpCode::GreaterEqual, OpCode::GreaterEqualInt, OpCode::GreaterEqualDouble); break;
+            case Op::Equal: opCode = pick(OpCode::Equal, OpCode::EqualInt, OpCode::EqualDouble); break;
+            case Op::NotEqual: opCode = pick(OpCode::NotEqual, OpCode::NotEqualInt, OpCode::NotEqualDouble); break;
+            case Op::Power: opCode = OpCode::Power; break;
+            default:
+                compileExpression(left);
+                compileExpression(right);
+                emitFailure(std::string("Unsupported operator: ") + opName(op) + " at line " + std::to_string(line), line);
+                return;
+        }
+        compileExpression(left);
+        compileExpression(right);
+        emit(opCode, line);
+    }
+};
@@ -0,0 +1,340 @@
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using NodeId = uint32_t;
+constexpr NodeId NO_NODE = UINT32_MAX;
+
+// A source file's tree flattened into parallel arrays indexed by 32-bit node IDs. The parser's
+// pointer tree is lowered into it and dropped right away; the resolver, both engines and the
+// compile cache all work on this. Each node has a kind, an operator, flags, a line and up to
+// three operands whose meaning depends on the kind:
+//
+//   WriteStatement          a: message
+//   VariableDeclaration     a: name, b: initializer or NO_NODE, c: slot; flags: IS_CONSTANT, IS_LOCAL
+//   ExpressionStatement     a: expression
+//   ReturnStatement         a: expression
+//   IfStatement             a: condition, b: then branch, c: else branch or NO_NODE
+//   ForStatement            a: first of four children (initializer, condition, increment, body)
+//   WhileStatement          a: condition, b: body
+//   BlockStatement          a: first child, b: child count
+//   IncludeStatement        a: file name
+//   FunctionDeclaration     a: function
+//   NumberExpression        a: the value as an int, or with IS_DOUBLE, a and b: a double
+//   StringExpression        a: value
+//   BoolExpression          a: 0 or 1
+//   ArrayExpression         a: first child, b: child count
+//   VariableExpression      a: name, b: slot; flags: IS_LOCAL
+//   BinaryExpression        a: left, b: right; op; flags: INT_OPERANDS, DOUBLE_OPERANDS
+//   UnaryExpression         a: operand; op; flags: IS_PREFIX
+//   FunctionCallExpression  a: name, b: first child, c: child count
+//   ReadExpression          a: prompt or NO_NODE
+//   IndexExpression         a: array, b: index
+//
+// Names, file names and string values are SymbolIds, children index `children`, functions index
+// `functions`. Slots and IS_LOCAL are filled in by the Resolver, INT_OPERANDS and
+// DOUBLE_OPERANDS by the TypeInference it runs. A node is added after the nodes it refers to, so
+// those have smaller IDs; only a lazily parsed body comes after its declaration. Everything is
+// append-only, so IDs stay valid while such bodies are added; only references into the vectors
+// are invalidated. The one exception is truncate().
+class FlatAst {
+public:
+    static constexpr uint8_t IS_CONSTANT = 1;
+    static constexpr uint8_t IS_LOCAL = 2;
+    static constexpr uint8_t IS_PREFIX = 4;
+    static constexpr uint8_t IS_DOUBLE = 8;
+    static constexpr uint8_t INT_OPERANDS = 16;
+    static constexpr uint8_t DOUBLE_OPERANDS = 32;
+
+    struct Function {
+        SymbolId name = 0;
+        uint32_t parameters = 0;    // first name in `parameterNames`
+        uint32_t parameterCount = 0;
+        uint32_t body = 0;          // first statement in `children`
+        uint32_t bodyCount = 0;
+        int slotCount = 0;          // parameters and locals, set by Resolver
+        int line = 0;
+
+        // Set while the body is still unparsed; see FunctionDeclaration.
+        std::string_view lazySource;
+        size_t lazyOffset = 0;
+        int lazyLine = 0;
+
+        bool isLazy() const {
+            return lazySource.data() != nullptr;
+        }
+    };
+
+    std::vector<NodeKind> kinds;
+    std::vector<Op> ops;
+    std::vector<uint8_t> flags;
+    std::vector<int32_t> lines;
+    std::vector<uint32_t> a;
+    std::vector<uint32_t> b;
+    std::vector<uint32_t> c;
+    std::vector<NodeId> children;
+    std::vector<SymbolId> parameterNames;
+    std::vector<Function> functions;
+
+    size_t size() const {
+        return kinds.size();
+    }
+
+    // The value of a NumberExpression with IS_DOUBLE, whose bits are split between a (the low
+    // half) and b.
+    double doubleValue(NodeId id) const {
+        uint64_t bits = a[id] | static_cast<uint64_t>(b[id]) << 32;
+        double value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    // The length of every column at some point, to truncate() back to.
+    struct Mark {
+        size_t nodes;
+        size_t children;
+        size_t parameterNames;
+        size_t functions;
+    };
+
+    Mark mark() const {
+        return { kinds.size(), children.size(), parameterNames.size(), functions.size() };
+    }
+
+    // Drops everything added since `mark` was taken; nothing may refer to it any more. The
+    // transient symbols of the dropped string literals are released with it.
+    void truncate(const Mark& mark) {
+        for (size_t i = mark.nodes; i < kinds.size(); ++i) {
+            if (kinds[i] == NodeKind::StringExpression || kinds[i] == NodeKind::IncludeStatement) {
+                Symbols::release(a[i]);
+            }
+        }
+        kinds.resize(mark.nodes);
+        ops.resize(mark.nodes);
+        flags.resize(mark.nodes);
+        lines.resize(mark.nodes);
+        a.resize(mark.nodes);
+        b.resize(mark.nodes);
+        c.resize(mark.nodes);
+        children.resize(mark.children);
+        parameterNames.resize(mark.parameterNames);
+        functions.resize(mark.functions);
+    }
+};
+
+// Lowers the parser's nodes into a FlatAst, one statement at a time, so the caller can free
+// each statement's nodes as soon as it has been added.
+class FlatAstBuilder {
+public:
+    explicit FlatAstBuilder(FlatAst& ast) : ast(ast) {}
+
+    NodeId add(const Statement* statement) {
+        return lower(statement);
+    }
+
+    // Parses the body of a function that was left lazy and appends it, once. The body still
+    // has to be resolved. On error the function stays lazy and the next call retries.
+    void parseLazyBody(uint32_t function) {
+        if (!ast.functions[function].isLazy()) {
+            return;
+        }
+        Arena arena;
+        const FlatAst::Function& lazy = ast.functions[function];
+        std::vector<Statement*> body = Parser::parseLazyBody(lazy.lazySource, lazy.lazyOffset, lazy.lazyLine, arena);
+        uint32_t first = list(body);
+
+        FlatAst::Function& entry = ast.functions[function];
+        entry.body = first;
+        entry.bodyCount = static_cast<uint32_t>(body.size());
+        entry.lazySource = std::string_view();
+    }
+
+private:
+    FlatAst& ast;
+
+    NodeId node(NodeKind kind, int line, uint32_t first = 0, uint32_t second = 0, uint32_t third = 0, Op op = Op::None, uint8_t flags = 0) {
+        ast.kinds.push_back(kind);
+        ast.ops.push_back(op);
+        ast.flags.push_back(flags);
+        ast.lines.push_back(line);
+        ast.a.push_back(first);
+        ast.b.push_back(second);
+        ast.c.push_back(third);
+        return static_cast<NodeId>(ast.kinds.size() - 1);
+    }
+
+    // Lowers the nodes first, since they may have lists of their own, then stores their IDs
+    // next to each other and returns the index of the first.
+    template <typename Nodes>
+    uint32_t list(const Nodes& nodes) {
+        std::vector<NodeId> ids;
+        ids.reserve(nodes.size());
+        for (const auto* child : nodes) {
+            ids.push_back(lower(child));
+        }
+        uint32_t first = static_cast<uint32_t>(ast.children.size());
+        ast.children.insert(ast.children.end(), ids.begin(), ids.end());
+        return first;
+    }
+
+    NodeId optional(const ASTNode* child) {
+        return child ? lower(child) : NO_NODE;
+    }
+
+    NodeId lower(const ASTNode* node) {
+        int line = node->line;
+        switch (node->kind) {
+            case NodeKind::WriteStatement:
+                return this->node(node->kind, line, lower(static_cast<const WriteStatement*>(node)->messageExpr));
+            case NodeKind::VariableDeclaration: {
+                const auto* varDecl = static_cast<const VariableDeclaration*>(node);
+                uint32_t name = varDecl->name;
+                NodeId initializer = optional(varDecl->initializer);
+                return this->node(node->kind, line, name, initializer, 0, Op::None, varDecl->isConstant ? FlatAst::IS_CONSTANT : 0);
+            }
+            case NodeKind::ExpressionStatement:
+                return this->node(node->kind, line, lower(static_cast<const ExpressionStatement*>(node)->expression));
+            case NodeKind::ReturnStatement:
+                return this->node(node->kind, line, lower(static_cast<const ReturnStatement*>(node)->expression));
+            case NodeKind::IfStatement: {
+                const auto* ifStmt = static_cast<const IfStatement*>(node);
+                NodeId condition = lower(ifStmt->condition);
+                NodeId thenBranch = lower(ifStmt->thenBranch);
+                NodeId elseBranch = optional(ifStmt->elseBranch);
+                return this->node(node->kind, line, condition, thenBranch, elseBranch);
+            }
+            case NodeKind::ForStatement: {
+                const auto* forStmt = static_cast<const ForStatement*>(node);
+                NodeId parts[] = { lower(forStmt->initializer), lower(forStmt->condition), lower(forStmt->increment), lower(forStmt->body) };
+                uint32_t first = static_cast<uint32_t>(ast.children.size());
+                ast.children.insert(ast.children.end(), std::begin(parts), std::end(parts));
+                return this->node(node->kind, line, first);
+            }
+            case NodeKind::WhileStatement: {
+                const auto* whileStmt = static_cast<const WhileStatement*>(node);
+                NodeId condition = lower(whileStmt->condition);
+                return this->node(node->kind, line, condition, lower(whileStmt->body));
+            }
+            case NodeKind::BlockStatement: {
+                const auto& statements = static_cast<const BlockStatement*>(node)->statements;
+                return this->node(node->kind, line, list(statements), static_cast<uint32_t>(statements.size()));
+            }
+            case NodeKind::IncludeStatement:
+                return this->node(node->kind, line, static_cast<const IncludeStatement*>(node)->fileName);
+            case NodeKind::FunctionDeclaration:
+                return this->node(node->kind, line, function(static_cast<const FunctionDeclaration*>(node)));
+            case NodeKind::NumberExpression: {
+                const auto* number = static_cast<const NumberExpression*>(node);
+                if (number->isDouble) {
+                    uint64_t bits;
+                    std::memcpy(&bits, &number->real, sizeof(bits));
+                    return this->node(node->kind, line, static_cast<uint32_t>(bits), static_cast<uint32_t>(bits >> 32), 0, Op::None,
+                                      FlatAst::IS_DOUBLE);
+                }
+                if (number->integer < INT32_MIN || number->integer > INT32_MAX) {
+                    throw std::runtime_error("Integer " + std::to_string(number->integer) + " does not fit in an int at line " +
+                                             std::to_string(line));
+                }
+                return this->node(node->kind, line, static_cast<uint32_t>(static_cast<int>(number->integer)));
+            }
+            case NodeKind::StringExpression:
+                return this->node(node->kind, line, static_cast<const StringExpression*>(node)->value);
+            case NodeKind::BoolExpression:
+                return this->node(node->kind, line, static_cast<const BoolExpression*>(node)->value ? 1 : 0);
+            case NodeKind::ArrayExpression: {
+                const auto& elements = static_cast<const ArrayExpression*>(node)->elements;
+                return this->node(node->kind, line, list(elements), static_cast<uint32_t>(elements.size()));
+            }
+            case NodeKind::VariableExpression:
+                return this->node(node->kind, line, static_cast<const VariableExpression*>(node)->name);
+            case NodeKind::BinaryExpression: {
+                const auto* binExpr = static_cast<const BinaryExpression*>(node);
+                NodeId left = lower(binExpr->left);
+                return this->node(node->kind, line, left, lower(binExpr->right), 0, binExpr->op);
+            }
+            case NodeKind::UnaryExpression: {
+                const auto* unaryExpr = static_cast<const UnaryExpression*>(node);
+                return this->node(node->kind, line, lower(unaryExpr->operand), 0, 0, unaryExpr->op, unaryExpr->isPrefix ? FlatAst::IS_PREFIX : 0);
+            }
+            case NodeKind::FunctionCallExpression: {
+                const auto* callExpr = static_cast<const FunctionCallExpression*>(node);
+                uint32_t name = callExpr->functionName;
+                uint32_t first = list(callExpr->arguments);
+                return this->node(node->kind, line, name, first, static_cast<uint32_t>(callExpr->arguments.size()));
+            }
+            case NodeKind::ReadExpression:
+                return this->node(node->kind, line, optional(static_cast<const ReadExpression*>(node)->prompt));
+            case NodeKind::IndexExpression: {
+                const auto* indexExpr = static_cast<const IndexExpression*>(node);
+                NodeId array = lower(indexExpr->array);
+                return this->node(node->kind, line, array, lower(indexExpr->index));
+            }
+        }
+        throw std::runtime_error("Unsupported node at line " + std::to_string(line));
+    }
+
+    uint32_t function(const FunctionDeclaration* funcDecl) {
+        FlatAst::Function entry;
+        entry.name = funcDecl->name;
+        entry.parameters = static_cast<uint32_t>(ast.parameterNames.size());
+        entry.parameterCount = static_cast<uint32_t>(funcDecl->parameters.size());
+        ast.parameterNames.insert(ast.parameterNames.end(), funcDecl->parameters.begin(), funcDecl->parameters.end());
+        entry.line = funcDecl->line;
+        if (funcDecl->isLazy()) {
+            entry.lazySource = funcDecl->lazySource;
+            entry.lazyOffset = funcDecl->lazyOffset;
+            entry.lazyLine = funcDecl->lazyLine;
+        } else {
+            entry.body = list(funcDecl->body);
+            entry.bodyCount = static_cast<uint32_t>(funcDecl->body.size());
+        }
+        ast.functions.push_back(entry);
+        return static_cast<uint32_t>(ast.functions.size() - 1);
+    }
+};
+
+// Parses `lexer`'s input and lowers it into `ast` one top-level statement at a time, dropping
+// each statement's parser nodes once it has been lowered.
+class StatementReader {
+public:
+    StatementReader(Lexer& lexer, FlatAst& ast, bool lazyFunctions = false) : parser(lexer, arena, lazyFunctions), builder(ast) {}
+
+    // Where the statement next() returns next starts, or the end of the input after the last.
+    size_t offset() const {
+        return parser.offset();
+    }
+
+    int line() const {
+        return parser.line();
+    }
+
+    // Returns the next statement, or NO_NODE at the end of the input.
+    NodeId next() {
+        Statement* statement = parser.parse();
+        if (!statement) {
+            return NO_NODE;
+        }
+        NodeId id = builder.add(statement);
+        arena.reset();
+        return id;
+    }
+
+private:
+    Arena arena;
+    Parser parser;
+    FlatAstBuilder builder;
+};
+
+// One source file ready to resolve and run. When function bodies were left unparsed, `source`
+// keeps the text they point into mapped (unless the caller keeps it alive some other way, as
+// the main script does).
+struct ParsedFile {
+    FlatAst ast;
+    std::vector<NodeId> statements;
+    std::unique_ptr<MappedFile> source;
+};
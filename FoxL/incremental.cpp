@@ -0,0 +1,218 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// A source file that is parsed once and then again after every edit, parsing only what the
+// edit touched. Each top-level statement (function declarations included) remembers the byte
+// offset and line it starts at and the nodes it was lowered to. An edit is re-lexed and
+// re-parsed from the statement before it, since text added after a statement can still extend
+// it (an `else`), up to the first statement that starts after the edit where an old one
+// started; the old statements from there on are kept, moved to their new offsets and lines.
+// Replaced statements are left in the tree until they make up half of it, when the whole file
+// is parsed again. Function bodies are never left lazy, so the tree does not point into the text.
+class IncrementalParser {
+public:
+    explicit IncrementalParser(std::string source) : text(std::move(source)) {
+        parseAll();
+    }
+
+    // Replaces the source, finding the edit by comparing the new text with the old.
+    void update(std::string_view source) {
+        size_t prefix = commonPrefix(text, source);
+        size_t suffix = commonSuffix(text, source, std::min(text.size(), source.size()) - prefix);
+        edit(prefix, text.size() - prefix - suffix, source.substr(prefix, source.size() - prefix - suffix));
+    }
+
+    // Replaces `removed` bytes at `offset` with `inserted`, as an editor reports a change. On a
+    // syntax error nothing changes, so the next edit is applied to the last text that parsed.
+    void edit(size_t offset, size_t removed, std::string_view inserted) {
+        if (offset > text.size() || removed > text.size() - offset) {
+            throw std::out_of_range("Edit past the end of the source");
+        }
+        if (removed == 0 && inserted.empty()) {
+            return;
+        }
+        std::string replaced = text.substr(offset, removed);
+        ptrdiff_t delta = static_cast<ptrdiff_t>(inserted.size()) - static_cast<ptrdiff_t>(removed);
+        text.replace(offset, removed, inserted);
+
+        // The statement before the one the edit starts in, whether at its start or inside it,
+        // unless the edit starts in the first; and the first statement that starts after the edit.
+        auto before = [](size_t position, const Span& span) { return position < span.start; };
+        size_t startedBy = static_cast<size_t>(std::upper_bound(spans.begin(), spans.end(), offset, before) - spans.begin());
+        size_t first = startedBy > 1 ? startedBy - 2 : 0;
+        size_t reused = static_cast<size_t>(std::lower_bound(spans.begin(), spans.end(), offset + removed,
+                                                             [](const Span& span, size_t position) { return span.start < position; }) -
+                                            spans.begin());
+        try {
+            reparse(first, reused, delta, offset + inserted.size());
+        } catch (...) {
+            text.replace(offset, inserted.size(), replaced);
+            throw;
+        }
+        if (tree.size() > 2 * liveNodes + COMPACT_SLACK) {
+            parseAll();
+        }
+    }
+
+    const std::string& source() const {
+        return text;
+    }
+
+    // The tree, including statements that have been replaced; only statements() are current.
+    const FlatAst& ast() const {
+        return tree;
+    }
+
+    const std::vector<NodeId>& statements() const {
+        return ids;
+    }
+
+    // A copy of the current tree for an engine to resolve and run.
+    ParsedFile parsedFile() const {
+        ParsedFile parsed;
+        parsed.ast = tree;
+        parsed.statements = ids;
+        return parsed;
+    }
+
+private:
+    static constexpr size_t COMPACT_SLACK = 4096;
+    static constexpr size_t COMPARE_BLOCK = 256;
+
+    // A top-level statement: where it starts, and the nodes and functions it was lowered to,
+    // which end with the statement itself.
+    struct Span {
+        size_t start;
+        int line;
+        NodeId firstNode;
+        uint32_t firstFunction;
+        uint32_t functionEnd;
+    };
+
+    std::string text;
+    FlatAst tree;
+    std::vector<Span> spans;
+    std::vector<NodeId> ids; // the statement of each span
+    size_t liveNodes = 0;
+
+    void parseAll() {
+        FlatAst previousTree = std::move(tree);
+        std::vector<Span> previousSpans = std::move(spans);
+        std::vector<NodeId> previousIds = std::move(ids);
+        size_t previousLiveNodes = liveNodes;
+        tree = FlatAst();
+        spans.clear();
+        ids.clear();
+        liveNodes = 0;
+        try {
+            reparse(0, 0, 0, 0);
+        } catch (...) {
+            tree = std::move(previousTree);
+            spans = std::move(previousSpans);
+            ids = std::move(previousIds);
+            liveNodes = previousLiveNodes;
+            throw;
+        }
+    }
+
+    // Parses from the start of spans[first] until a statement starts at `editEnd` or later
+    // exactly where the old statement spans[j] (j >= reused) started, moved by `delta`, and
+    // puts what was parsed in place of spans[first, j). Without such a statement it parses to
+    // the end of the file. Lines are moved by however far the lexer's count moved, which skips
+    // newlines inside string literals.
+    void reparse(size_t first, size_t reused, ptrdiff_t delta, size_t editEnd) {
+        size_t position = first < spans.size() && first > 0 ? spans[first].start : 0;
+        int line = first < spans.size() && first > 0 ? spans[first].line : 1;
+        FlatAst::Mark mark = tree.mark();
+        std::vector<Span> parsed;
+        std::vector<NodeId> parsedIds;
+        size_t j = reused;
+        int lineDelta = 0;
+        try {
+            Lexer lexer(text, position, line);
+            StatementReader reader(lexer, tree);
+            for (;;) {
+                size_t start = reader.offset();
+                if (start >= editEnd) {
+                    while (j < spans.size() && static_cast<size_t>(static_cast<ptrdiff_t>(spans[j].start) + delta) < start) {
+                        ++j;
+                    }
+                    if (j < spans.size() && static_cast<size_t>(static_cast<ptrdiff_t>(spans[j].start) + delta) == start) {
+                        lineDelta = reader.line() - spans[j].line;
+                        break;
+                    }
+                }
+                Span span{ start, reader.line(), static_cast<NodeId>(tree.size()), static_cast<uint32_t>(tree.functions.size()), 0 };
+                NodeId statement = reader.next();
+                if (statement == NO_NODE) {
+                    j = spans.size();
+                    break;
+                }
+                span.functionEnd = static_cast<uint32_t>(tree.functions.size());
+                parsed.push_back(span);
+                parsedIds.push_back(statement);
+            }
+        } catch (...) {
+            tree.truncate(mark);
+            throw;
+        }
+
+        for (size_t i = j; i < spans.size(); ++i) {
+            spans[i].start = static_cast<size_t>(static_cast<ptrdiff_t>(spans[i].start) + delta);
+            if (lineDelta != 0) {
+                moveLines(spans[i], ids[i], lineDelta);
+            }
+        }
+        for (size_t i = first; i < j; ++i) {
+            liveNodes -= ids[i] + 1 - spans[i].firstNode;
+        }
+        for (size_t i = 0; i < parsed.size(); ++i) {
+            liveNodes += parsedIds[i] + 1 - parsed[i].firstNode;
+        }
+        spans.erase(spans.begin() + first, spans.begin() + j);
+        spans.insert(spans.begin() + first, parsed.begin(), parsed.end());
+        ids.erase(ids.begin() + first, ids.begin() + j);
+        ids.insert(ids.begin() + first, parsedIds.begin(), parsedIds.end());
+    }
+
+    void moveLines(Span& span, NodeId statement, int lineDelta) {
+        span.line += lineDelta;
+        for (NodeId id = span.firstNode; id <= statement; ++id) {
+            tree.lines[id] += lineDelta;
+        }
+        for (uint32_t function = span.firstFunction; function < span.functionEnd; ++function) {
+            tree.functions[function].line += lineDelta;
+        }
+    }
+
+    // Both compare a block at a time while the texts agree on all of it.
+    static size_t commonPrefix(std::string_view a, std::string_view b) {
+        size_t length = std::min(a.size(), b.size());
+        size_t common = 0;
+        while (length - common >= COMPARE_BLOCK && std::memcmp(a.data() + common, b.data() + common, COMPARE_BLOCK) == 0) {
+            common += COMPARE_BLOCK;
+        }
+        while (common < length && a[common] == b[common]) {
+            ++common;
+        }
+        return common;
+    }
+
+    static size_t commonSuffix(std::string_view a, std::string_view b, size_t limit) {
+        size_t common = 0;
+        while (limit - common >= COMPARE_BLOCK &&
+               std::memcmp(a.data() + a.size() - common - COMPARE_BLOCK, b.data() + b.size() - common - COMPARE_BLOCK, COMPARE_BLOCK) == 0) {
+            common += COMPARE_BLOCK;
+        }
+        while (common < limit && a[a.size() - 1 - common] == b[b.size() - 1 - common]) {
+            ++common;
+        }
+        return common;
+    }
+};
@@ -0,0 +1,42 @@
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#define FOXL_HAVE_READ 1
+#endif
+
+// A file descriptor read a chunk at a time, typically standard input. A read returns as soon
+// as any bytes are available, so a script piped in can be lexed while whatever writes it is
+// still running. Without POSIX read() only standard input is supported, a line at a time.
+class InputStream {
+public:
+    explicit InputStream(int fd = 0) : fd(fd) {}
+
+    // Reads at most `capacity` bytes into `buffer` and returns how many; 0 means end of input.
+    size_t read(char* buffer, size_t capacity) {
+#ifdef FOXL_HAVE_READ
+        for (;;) {
+            ssize_t count = ::read(fd, buffer, capacity);
+            if (count >= 0) {
+                return static_cast<size_t>(count);
+            }
+            if (errno != EINTR) {
+                throw std::runtime_error(std::string("Could not read input: ") + std::strerror(errno));
+            }
+        }
+#else
+        if (capacity < 2 || !std::fgets(buffer, static_cast<int>(capacity < 65536 ? capacity : 65536), stdin)) {
+            return 0;
+        }
+        return std::strlen(buffer);
+#endif
+    }
+
+private:
+    int fd;
+};
@@ -1,420 +1,938 @@
-#include <unordered_map>
-#include <functional>
-#include <cmath>
-#include <stdexcept>
-#include <variant>
-#include <iostream>
-#include <vector>
-#include <string>
-#include <memory>
-#include <sstream>
-#include <fstream>
-#include <algorithm>
-#include <iterator>
-#include <typeinfo>
-#include <optional>
-#include <filesystem>
-
-class ReturnException : public std::runtime_error {
-public:
-    std::variant<int, double, std::string, bool, std::vector<int>, std::vector<std::string>> value;
-
-    ReturnException(const std::variant<int, double, std::string, bool, std::vector<int>, std::vector<std::string>>& value)
-        : std::runtime_error("Return"), value(value) {}
-};
-
-class Interpreter {
-public:
-    Interpreter(const std::string& scriptFileName) {
-        std::string baseFileName = scriptFileName.substr(0, scriptFileName.find_last_of('.'));
-        dataFileName = baseFileName + ".FoxLData.foxl";
-        loadVariablesFromFile();
-    }
-
-    ~Interpreter() {
-        saveVariablesToFile();
-        std::filesystem::remove(dataFileName);
-    }
-
-    void interpret(const std::vector<std::unique_ptr<Statement>>& statements) {
-        for (const auto& statement : statements) {
-            execute(statement.get());
-        }
-    }
-
-private:
-    struct Variable {
-        std::variant<int, double, std::string, bool, std::vector<int>, std::vector<std::string>> value;
-        bool isConstant;
-    };
-
-    using Function = std::pair<std::vector<std::string>, std::vector<std::unique_ptr<Statement>>>;
-
-    std::unordered_map<std::string, Variable> variables;
-    std::unordered_map<std::string, Function> functions;
-    std::string dataFileName;
-
-    void execute(const Statement* statement);
-
-    std::variant<int, double, std::string, bool, std::vector<int>, std::vector<std::string>> evaluate(const Expression* expr);
-
-    void loadVariablesFromFile() {
-        std::ifstream inFile(dataFileName);
-        if (inFile) {
-            std::string line;
-            while (std::getline(inFile, line)) {
-                std::istringstream iss(line);
-                std::string type, name;
-                iss >> type >> name;
-
-                if (type == "variable" || type == "constant") {
-                    bool isConstant = (type == "constant");
-                    std::string valueStr;
-                    std::getline(iss, valueStr);
-                    std::variant<int, double, std::string, bool, std::vector<int>, std::vector<std::string>> value;
-
-                    if (valueStr[0] == '[') {
-                        if (valueStr.find("\"") != std::string::npos) {
-                            std::vector<std::string> strArray;
-                            valueStr.erase(0, 1);
-                            valueStr.pop_back();
-                            std::istringstream arrayStream(valueStr);
-                            std::string element;
-                            while (std::getline(arrayStream, element, ',')) {
-                                element.erase(0, 1);
-                                element.pop_back();
-                                strArray.push_back(element);
-                            }
-                            value = strArray;
-                        } else { // Integer array
-                            std::vector<int> intArray;
-                            valueStr.erase(0, 1);
-                            valueStr.pop_back();
-                            std::istringstream arrayStream(valueStr);
-                            std::string element;
-                            while (std::getline(arrayStream, element, ',')) {
-                                intArray.push_back(std::stoi(element));
-                            }
-                            value = intArray;
-                        }
-                    } else if (valueStr == "true" || valueStr == "false") {
-                        value = (valueStr == "true");
-                    } else if (valueStr.find('.') != std::string::npos) {
-                        value = std::stod(valueStr);
-                    } else {
-                        value = std::stoi(valueStr);
-                    }
-
-                    variables[name] = { value, isConstant };
-                }
-            }
-        }
-    }
-
-    void saveVariablesToFile() {
-        std::ofstream outFile(dataFileName);
-        for (const auto& [name, variable] : variables) {
-            outFile << (variable.isConstant ? "constant" : "variable") << " " << name << " ";
-            std::visit([&](auto&& arg) {
-                using T = std::decay_t<decltype(arg)>;
-                if constexpr (std::is_same_v<T, int>) {
-                    outFile << arg;
-                } else if constexpr (std::is_same_v<T, double>) {
-                    outFile << arg;
-                } else if constexpr (std::is_same_v<T, std::string>) {
-                    outFile << arg;
-                } else if constexpr (std::is_same_v<T, bool>) {
-                    outFile << (arg ? "true" : "false");
-                } else if constexpr (std::is_same_v<T, std::vector<int>>) {
-                    outFile << "[";
-                    for (size_t i = 0; i < arg.size(); ++i) {
-                        outFile << arg[i];
-                        if (i < arg.size() - 1) {
-                            outFile << ",";
-                        }
-                    }
-                    outFile << "]";
-                } else if constexpr (std::is_same_v<T, std::vector<std::string>>) {
-                    outFile << "[";
-                    for (size_t i = 0; i < arg.size(); ++i) {
-                        outFile << "\"" << arg[i] << "\"";
-                        if (i < arg.size() - 1) {
-                            outFile << ",";
-                        }
-                    }
-                    outFile << "]";
-                }
-            }, variable.value);
-            outFile << std::endl;
-        }
-    }
-
-    std::variant<int, double, std::string, bool, std::vector<int>, std::vector<std::string>> evaluateNumberExpression(const NumberExpression* expr);
-    std::variant<int, double, std::string, bool, std::vector<int>, std::vector<std::string>> evaluateStringExpression(const StringExpression* expr);
-    std::variant<int, double, std::string, bool, std::vector<int>, std::vector<std::string>> evaluateBoolExpression(const BoolExpression* expr);
-    std::variant<int, double, std::string, bool, std::vector<int>, std::vector<std::string>> evaluateVariableExpression(const VariableExpression* expr);
-    std::variant<int, double, std::string, bool, std::vector<int>, std::vector<std::string>> evaluateBinaryExpression(const BinaryExpression* expr);
-    std::variant<int, double, std::string, bool, std::vector<int>, std::vector<std::string>> evaluateReadExpression(const ReadExpression* expr);
-    std::variant<int, double, std::string, bool, std::vector<int>, std::vector<std::string>> evaluateIndexExpression(const IndexExpression* expr);
-    std::variant<int, double, std::string, bool, std::vector<int>, std::vector<std::string>> evaluateArrayExpression(const ArrayExpression* expr);
-    std::variant<int, double, std::string, bool, std::vector<int>, std::vector<std::string>> evaluateFunctionCallExpression(const FunctionCallExpression* expr);
-
-    std::variant<int, double, std::string, bool, std::vector<int>, std::vector<std::string>> handleAssignment(const BinaryExpression* expr, const std::variant<int, double, std::string, bool, std::vector<int>, std::vector<std::string>>& left, const std::variant<int, double, std::string, bool, std::vector<int>, std::vector<std::string>>& right);
-    std::variant<int, double, std::string, bool, std::vector<int>, std::vector<std::string>> handleArrayAssignment(const IndexExpression* indexExpr, const std::variant<int, double, std::string, bool, std::vector<int>, std::vector<std::string>>& right);
-    std::variant<int, double, std::string, bool, std::vector<int>, std::vector<std::string>> handleAddition(const std::variant<int, double, std::string, bool, std::vector<int>, std::vector<std::string>>& left, const std::variant<int, double, std::string, bool, std::vector<int>, std::vector<std::string>>& right);
-    std::variant<int, double, std::string, bool, std::vector<int>, std::vector<std::string>> handleSubtraction(const std::variant<int, double, std::string, bool, std::vector<int>, std::vector<std::string>>& left, const std::variant<int, double, std::string, bool, std::vector<int>, std::vector<std::string>>& right);
-    std::variant<int, double, std::string, bool, std::vector<int>, std::vector<std::string>> handleMultiplication(const std::variant<int, double, std::string, bool, std::vector<int>, std::vector<std::string>>& left, const std::variant<int, double, std::string, bool, std::vector<int>, std::vector<std::string>>& right);
-    std::variant<int, double, std::string, bool, std::vector<int>, std::vector<std::string>> handleDivision(const std::variant<int, double, std::string, bool, std::vector<int>, std::vector<std::string>>& left, const std::variant<int, double, std::string, bool, std::vector<int>, std::vector<std::string>>& right);
-    std::variant<int, double, std::string, bool, std::vector<int>, std::vector<std::string>> handleLessThan(const std::variant<int, double, std::string, bool, std::vector<int>, std::vector<std::string>>& left, const std::variant<int, double, std::string, bool, std::vector<int>, std::vector<std::string>>& right);
-    std::variant<int, double, std::string, bool, std::vector<int>, std::vector<std::string>> handleGreaterThan(const std::variant<int, double, std::string, bool, std::vector<int>, std::vector<std::string>>& left, const std::variant<int, double, std::string, bool, std::vector<int>, std::vector<std::string>>& right);
-    std::variant<int, double, std::string, bool, std::vector<int>, std::vector<std::string>> handleLessThanOrEqual(const std::variant<int, double, std::string, bool, std::vector<int>, std::vector<std::string>>& left, const std::variant<int, double, std::string, bool, std::vector<int>, std::vector<std::string>>& right);
-    std::variant<int, double, std::string, bool, std::vector<int>, std::vector<std::string>> handleGreaterThanOrEqual(const std::variant<int, double, std::string, bool, std::vector<int>, std::vector<std::string>>& left, const std::variant<int, double, std::string, bool, std::vector<int>, std::vector<std::string>>& right);
-
-    bool isNumber(const std::string& s);
-    bool isDouble(const std::string& s);
-
-    template <typename T>
-    static void printValue(const T& value);
-
-    template <typename T>
-    static void printValue(const std::vector<T>& vec);
-
-    std::vector<std::unique_ptr<Statement>> cloneStatements(const std::vector<std::unique_ptr<Statement>>& statements);
-    std::unique_ptr<Statement> cloneStatement(const Statement* stmt);
-    std::unique_ptr<Expression> cloneExpression(const Expression* expr);
-};
-
-void Interpreter::execute(const Statement* statement) {
-    try {
-        if (const auto* writeStmt = dynamic_cast<const WriteStatement*>(statement)) {
-            auto value = evaluate(writeStmt->messageExpr.get());
-            std::visit([](auto&& arg) { printValue(arg); }, value);
-        } else if (const auto* varDecl = dynamic_cast<const VariableDeclaration*>(statement)) {
-            if (variables.find(varDecl->name) != variables.end() && variables[varDecl->name].isConstant) {
-                throw std::runtime_error("Cannot reassign constant variable: " + varDecl->name);
-            }
-
-            std::variant<int, double, std::string, bool, std::vector<int>, std::vector<std::string>> value;
-            if (varDecl->initializer) {
-                value = evaluate(varDecl->initializer.get());
-            } else {
-                value = 0;
-            }
-            variables[varDecl->name] = { value, varDecl->type == "const" };
-
-            std::ofstream outFile(dataFileName, std::ios_base::app);
-            outFile << (varDecl->type == "const" ? "constant" : "variable") << " " << varDecl->name << " ";
-            std::visit([&](auto&& arg) {
-                using T = std::decay_t<decltype(arg)>;
-                if constexpr (std::is_same_v<T, int>) {
-                    outFile << arg;
-                } else if constexpr (std::is_same_v<T, double>) {
-                    outFile << arg;
-                } else if constexpr (std::is_same_v<T, std::string>) {
-                    outFile << arg;
-                } else if constexpr (std::is_same_v<T, bool>) {
-                    outFile << (arg ? "true" : "false");
-                } else if constexpr (std::is_same_v<T, std::vector<int>>) {
-                    outFile << "[";
-                    for (size_t i = 0; i < arg.size(); ++i) {
-                        outFile << arg[i];
-                        if (i < arg.size() - 1) {
-                            outFile << ",";
-                        }
-                    }
-                    outFile << "]";
-                } else if constexpr (std::is_same_v<T, std::vector<std::string>>) {
-                    outFile << "[";
-                    for (size_t i = 0; i < arg.size(); ++i) {
-                        outFile << "\"" << arg[i] << "\"";
-                        if (i < arg.size() - 1) {
-                            outFile << ",";
-                        }
-                    }
-                    outFile << "]";
-                }
-            }, value);
-            outFile << std::endl;
-        } else if (const auto* varExpr = dynamic_cast<const VariableExpression*>(statement)) {
-            if (variables.find(varExpr->name) != variables.end() && !variables[varExpr->name].isConstant) {
-                variables[varExpr->name] = { evaluate(varExpr), false };
-            } else {
-                throw std::runtime_error("Cannot reassign constant variable: " + varExpr->name);
-            }
-        } else if (const auto* funcDecl = dynamic_cast<const FunctionDeclaration*>(statement)) {
-            functions[funcDecl->name] = { funcDecl->parameters, cloneStatements(funcDecl->body) };
-        } else if (const auto* ifStmt = dynamic_cast<const IfStatement*>(statement)) {
-            if (std::get<bool>(evaluate(ifStmt->condition.get()))) {
-                execute(ifStmt->thenBranch.get());
-            } else if (ifStmt->elseBranch) {
-                execute(ifStmt->elseBranch.get());
-            }
-        } else if (const auto* forStmt = dynamic_cast<const ForStatement*>(statement)) {
-            execute(forStmt->initializer.get());
-            while (std::get<bool>(evaluate(forStmt->condition.get()))) {
-                execute(forStmt->body.get());
-                execute(forStmt->increment.get());
-            }
-        } else if (const auto* whileStmt = dynamic_cast<const WhileStatement*>(statement)) {
-            while (std::get<bool>(evaluate(whileStmt->condition.get()))) {
-                execute(whileStmt->body.get());
-            }
-        } else if (const auto* returnStmt = dynamic_cast<const ReturnStatement*>(statement)) {
-            auto value = evaluate(returnStmt->expression.get());
-            throw ReturnException(value);
-        } else if (const auto* blockStmt = dynamic_cast<const BlockStatement*>(statement)) {
-            for (const auto& stmt : blockStmt->statements) {
-                execute(stmt.get());
-            }
-        } else if (const auto* includeStmt = dynamic_cast<const IncludeStatement*>(statement)) {
-            std::ifstream file(includeStmt->fileName);
-            if (!file) {
-                throw std::runtime_error("Error: Could not open include file " + includeStmt->fileName);
-            }
-
-            std::string input((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
-            file.close();
-
-            Lexer lexer(input);
-            Parser parser(lexer);
-
-            try {
-                std::vector<std::unique_ptr<Statement>> statements;
-                while (auto ast = parser.parse()) {
-                    if (auto stmt = dynamic_cast<Statement*>(ast.get())) {
-                        statements.push_back(std::unique_ptr<Statement>(stmt));
-                        ast.release();
-                    }
-                }
-
-                interpret(statements);
-            } catch (const std::exception& e) {
-                throw std::runtime_error("Error in included file: " + std::string(e.what()));
-            }
-        }
-    } catch (const ReturnException& e) {
-        throw;
-    } catch (const std::exception& e) {
-        std::cerr << "Error executing statement: " << e.what() << std::endl;
-    }
-}
-
-std::variant<int, double, std::string, bool, std::vector<int>, std::vector<std::string>> Interpreter::evaluate(const Expression* expr) {
-    if (const auto* numberExpr = dynamic_cast<const NumberExpression*>(expr)) {
-        return static_cast<int>(numberExpr->value); // Convert double to int for consistency
-    } else if (const auto* strExpr = dynamic_cast<const StringExpression*>(expr)) {
-        return strExpr->value;
-    } else if (const auto* boolExpr = dynamic_cast<const BoolExpression*>(expr)) {
-        return boolExpr->value;
-    } else if (const auto* varExpr = dynamic_cast<const VariableExpression*>(expr)) {
-        if (variables.find(varExpr->name) != variables.end()) {
-            return variables[varExpr->name].value;
-        } else {
-            throw std::runtime_error("Undefined variable: " + varExpr->name);
-        }
-    } else if (const auto* binExpr = dynamic_cast<const BinaryExpression*>(expr)) {
-        return evaluateBinaryExpression(binExpr);
-    } else if (const auto* readExpr = dynamic_cast<const ReadExpression*>(expr)) {
-        return evaluateReadExpression(readExpr);
-    } else if (const auto* indexExpr = dynamic_cast<const IndexExpression*>(expr)) {
-        return evaluateIndexExpression(indexExpr);
-    } else if (const auto* arrayExpr = dynamic_cast<const ArrayExpression*>(expr)) {
-        return evaluateArrayExpression(arrayExpr);
-    } else if (const auto* funcCallExpr = dynamic_cast<const FunctionCallExpression*>(expr)) {
-        return evaluateFunctionCallExpression(funcCallExpr);
-    }
-
-    std::stringstream ss;
-    ss << "Unsupported expression type: " << typeid(*expr).name() << " at line " << std::to_string(expr->line);
-    throw std::runtime_error(ss.str());
-}
-
-bool Interpreter::isNumber(const std::string& s) {
-    return !s.empty() && std::find_if(s.begin(), s.end(), [](unsigned char c) { return !std::isdigit(c); }) == s.end();
-}
-
-bool Interpreter::isDouble(const std::string& s) {
-    std::istringstream iss(s);
-    double d;
-    iss >> d;
-    return iss.eof() && !iss.fail();
-}
-
-template <typename T>
-void Interpreter::printValue(const T& value) {
-    std::cout << value << std::endl;
-}
-
-template <typename T>
-void Interpreter::printValue(const std::vector<T>& vec) {
-    std::cout << "[";
-    for (size_t i = 0; i < vec.size(); ++i) {
-        std::cout << vec[i];
-        if (i < vec.size() - 1) {
-            std::cout << ", ";
-        }
-    }
-    std::cout << "]" << std::endl;
-}
-
-std::vector<std::unique_ptr<Statement>> Interpreter::cloneStatements(const std::vector<std::unique_ptr<Statement>>& statements) {
-    std::vector<std::unique_ptr<Statement>> clones;
-    for (const auto& stmt : statements) {
-        clones.push_back(cloneStatement(stmt.get()));
-    }
-    return clones;
-}
-
-std::unique_ptr<Statement> Interpreter::cloneStatement(const Statement* stmt) {
-    if (const auto* writeStmt = dynamic_cast<const WriteStatement*>(stmt)) {
-        return std::make_unique<WriteStatement>(cloneExpression(writeStmt->messageExpr.get()), writeStmt->line);
-    } else if (const auto* varDecl = dynamic_cast<const VariableDeclaration*>(stmt)) {
-        return std::make_unique<VariableDeclaration>(varDecl->type, varDecl->name, cloneExpression(varDecl->initializer.get()), varDecl->line);
-    } else if (const auto* funcDecl = dynamic_cast<const FunctionDeclaration*>(stmt)) {
-        return std::make_unique<FunctionDeclaration>(funcDecl->name, funcDecl->parameters, cloneStatements(funcDecl->body), funcDecl->line);
-    } else if (const auto* ifStmt = dynamic_cast<const IfStatement*>(stmt)) {
-        return std::make_unique<IfStatement>(cloneExpression(ifStmt->condition.get()), cloneStatement(ifStmt->thenBranch.get()), ifStmt->elseBranch ? cloneStatement(ifStmt->elseBranch.get()) : nullptr, ifStmt->line);
-    } else if (const auto* forStmt = dynamic_cast<const ForStatement*>(stmt)) {
-        return std::make_unique<ForStatement>(cloneStatement(forStmt->initializer.get()), cloneExpression(forStmt->condition.get()), cloneStatement(forStmt->increment.get()), cloneStatement(forStmt->body.get()), forStmt->line);
-    } else if (const auto* whileStmt = dynamic_cast<const WhileStatement*>(stmt)) {
-        return std::make_unique<WhileStatement>(cloneExpression(whileStmt->condition.get()), cloneStatement(whileStmt->body.get()), whileStmt->line);
-    } else if (const auto* returnStmt = dynamic_cast<const ReturnStatement*>(stmt)) {
-        return std::make_unique<ReturnStatement>(cloneExpression(returnStmt->expression.get()), returnStmt->line);
-    } else if (const auto* blockStmt = dynamic_cast<const BlockStatement*>(stmt)) {
-        return std::make_unique<BlockStatement>(cloneStatements(blockStmt->statements), blockStmt->line);
-    } else if (const auto* includeStmt = dynamic_cast<const IncludeStatement*>(stmt)) {
-        return std::make_unique<IncludeStatement>(includeStmt->fileName, includeStmt->line);
-    }
-    throw std::runtime_error("Unsupported statement type");
-}
-
-std::unique_ptr<Expression> Interpreter::cloneExpression(const Expression* expr) {
-    if (const auto* numberExpr = dynamic_cast<const NumberExpression*>(expr)) {
-        return std::make_unique<NumberExpression>(numberExpr->value, numberExpr->line);
-    } else if (const auto* strExpr = dynamic_cast<const StringExpression*>(expr)) {
-        return std::make_unique<StringExpression>(strExpr->value, strExpr->line);
-    } else if (const auto* boolExpr = dynamic_cast<const BoolExpression*>(expr)) {
-        return std::make_unique<BoolExpression>(boolExpr->value, boolExpr->line);
-    } else if (const auto* varExpr = dynamic_cast<const VariableExpression*>(expr)) {
-        return std::make_unique<VariableExpression>(varExpr->name, varExpr->line);
-    } else if (const auto* binExpr = dynamic_cast<const BinaryExpression*>(expr)) {
-        return std::make_unique<BinaryExpression>(cloneExpression(binExpr->left.get()), binExpr->op, cloneExpression(binExpr->right.get()), binExpr->line);
-    } else if (const auto* readExpr = dynamic_cast<const ReadExpression*>(expr)) {
-        return std::make_unique<ReadExpression>(readExpr->prompt ? cloneExpression(readExpr->prompt.get()) : nullptr, readExpr->line);
-    } else if (const auto* indexExpr = dynamic_cast<const IndexExpression*>(expr)) {
-        return std::make_unique<IndexExpression>(cloneExpression(indexExpr->array.get()), cloneExpression(indexExpr->index.get()), indexExpr->line);
-    } else if (const auto* arrayExpr = dynamic_cast<const ArrayExpression*>(expr)) {
-        std::vector<std::unique_ptr<Expression>> elements;
-        for (const auto& elem : arrayExpr->elements) {
-            elements.push_back(cloneExpression(elem.get()));
-        }
-        return std::make_unique<ArrayExpression>(std::move(elements), arrayExpr->line);
-    } else if (const auto* funcCallExpr = dynamic_cast<const FunctionCallExpression*>(expr)) {
-        std::vector<std::unique_ptr<Expression>> arguments;
-        for (const auto& arg : funcCallExpr->arguments) {
-            arguments.push_back(cloneExpression(arg.get()));
-        }
-        return std::make_unique<FunctionCallExpression>(funcCallExpr->functionName, std::move(arguments), funcCallExpr->line);
-    }
-    throw std::runtime_error("Unsupported expression type");
-}
+#include <unordered_map>
+#include <functional>
+#include <cmath>
+#include <stdexcept>
+#include <iostream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <sstream>
+#include <fstream>
+#include <algorithm>
+#include <iterator>
+#include <optional>
+#include <filesystem>
+#include <deque>
+#include <unordered_set>
+#include <chrono>
+
+// How a statement finished. A `return` unwinds through its enclosing statements as an
+// ordinary result rather than an exception; the returned value is in Interpreter::returnValue.
+enum class Completion {
+    Normal,
+    Return
+};
+
+class VM;
+
+class Interpreter {
+public:
+    Interpreter(const std::string& scriptFileName, PersistPolicy persistPolicy = {}, bool revalidateIncludes = false,
+                bool lazyFunctions = false)
+        : dataFileName(scriptFileName.substr(0, scriptFileName.find_last_of('.')) + ".FoxLData.foxl"),
+          persistPolicy(persistPolicy), writer(dataFileName), lastFlush(std::chrono::steady_clock::now()),
+          modules(revalidateIncludes, lazyFunctions) {
+        modules.markLoaded(scriptFileName);
+        loadVariablesFromFile();
+    }
+
+    ~Interpreter() {
+        writer.stop();
+        saveVariablesToFile();
+        std::filesystem::remove(dataFileName);
+    }
+
+    // Parses the include graph of a script ahead of running it; see ModuleRegistry::preload.
+    void preloadIncludes(const ParsedFile& parsed) {
+        modules.preload(parsed.ast, parsed.statements);
+    }
+
+    // Resolves and runs a script or an included file. Its tree is kept for as long as the
+    // interpreter, since the functions it declares stay callable.
+    void interpret(ParsedFile parsed) {
+        files.push_back(std::move(parsed));
+        ParsedFile& file = files.back();
+        int slotCount = resolver.resolve(file.ast, file.statements);
+        globals.resize(resolver.globalNames().size(), nullptr);
+
+        FlatAst* enclosingAst = ast;
+        size_t base = locals.size();
+        size_t enclosingBase = frameBase;
+        locals.resize(base + slotCount);
+        ast = &file.ast;
+        frameBase = base;
+        try {
+            for (const auto& statement : file.statements) {
+                if (execute(statement) == Completion::Return) {
+                    break; // a top-level return ends the script
+                }
+            }
+        } catch (...) {
+            ast = enclosingAst;
+            frameBase = enclosingBase;
+            locals.resize(base);
+            throw;
+        }
+        ast = enclosingAst;
+        frameBase = enclosingBase;
+        locals.resize(base);
+    }
+
+    // Runs a script as it is read: each top-level statement is parsed, resolved and run before
+    // the next one is parsed past its first token. Resolving one statement at a time gives the
+    // same slots as resolving the whole script, since everything declared at its top level is
+    // global. Only statements that declared functions keep their nodes once they have run.
+    void interpretStream(Lexer& lexer) {
+        files.emplace_back();
+        FlatAst& tree = files.back().ast;
+        StatementReader reader(lexer, tree);
+        ast = &tree;
+        frameBase = locals.size();
+        for (;;) {
+            FlatAst::Mark mark = tree.mark();
+            NodeId statement = reader.next();
+            if (statement == NO_NODE) {
+                break;
+            }
+            int slotCount = resolver.resolve(tree, { statement });
+            globals.resize(resolver.globalNames().size(), nullptr);
+            locals.resize(frameBase);
+            locals.resize(frameBase + slotCount); // fresh slots, as TypeInference expects
+            Completion completion = execute(statement);
+            if (tree.functions.size() == mark.functions) {
+                tree.truncate(mark);
+            }
+            if (completion == Completion::Return) {
+                break; // a top-level return ends the script
+            }
+        }
+    }
+
+private:
+    friend class VM;
+
+    struct Variable {
+        Value value;
+        bool isConstant;
+    };
+
+    std::unordered_map<SymbolId, Variable> variables;
+    std::string dataFileName;
+
+    // Declared globals are marked dirty and written to the data file in batches by a
+    // background thread, as often as persistPolicy allows; sync() forces them out.
+    PersistPolicy persistPolicy;
+    PersistenceWriter writer;
+    std::unordered_set<SymbolId> dirtyVariables;
+    size_t pendingRecords = 0;
+    std::chrono::steady_clock::time_point lastFlush;
+
+    // A function is its index in the tree of the file that declared it.
+    struct FunctionRef {
+        FlatAst* ast;
+        uint32_t index;
+    };
+
+    // The main script and every included file, and the tree of whichever one is running.
+    std::deque<ParsedFile> files;
+    FlatAst* ast = nullptr;
+    std::unordered_map<SymbolId, FunctionRef> functions;
+    ModuleRegistry modules; // shared with the VM
+
+    // Globals are looked up by name once per resolved slot; locals of every active call live
+    // in one flat array, with the current frame starting at frameBase.
+    Resolver resolver;
+    std::vector<Variable*> globals;
+    std::vector<Value> locals;
+    size_t frameBase = 0;
+
+    Variable* findGlobal(int slot);
+    void parseFunctionBody(const FunctionRef& function);
+    Value& assignableValue(NodeId varExpr);
+
+    Value returnValue;
+
+    Completion execute(NodeId statement);
+
+    Value evaluate(NodeId expr);
+
+    void loadVariablesFromFile() {
+        MappedFile file(dataFileName);
+        if (!file.isOpen()) {
+            return;
+        }
+        if (Snapshot::isSnapshot(file.data(), file.size())) {
+            Snapshot::read(file.data(), file.size(), [this](const std::string& name, Value value, bool isConstant) {
+                variables[Symbols::intern(name)] = { std::move(value), isConstant };
+            });
+        } else if (file.size() > 0) {
+            // Data files written before the binary snapshot: read them once and rewrite them.
+            loadTextVariables(std::string(file.view()));
+            saveVariablesToFile();
+        }
+    }
+
+    void loadTextVariables(const std::string& text) {
+        std::istringstream inFile(text);
+        std::string line;
+        while (std::getline(inFile, line)) {
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            std::istringstream iss(line);
+            std::string type, name;
+            iss >> type >> name;
+
+            if (type == "variable" || type == "constant") {
+                bool isConstant = (type == "constant");
+                std::string valueStr;
+                std::getline(iss, valueStr);
+                if (!valueStr.empty() && valueStr[0] == ' ') {
+                    valueStr.erase(0, 1);
+                }
+                try {
+                    variables[Symbols::intern(name)] = { parseTextValue(valueStr), isConstant };
+                } catch (const std::logic_error&) {
+                    // skip entries that were not written by FoxL
+                }
+            }
+        }
+    }
+
+    static Value parseTextValue(std::string valueStr) {
+        if (!valueStr.empty() && valueStr[0] == '[' && valueStr.back() == ']') {
+            valueStr.erase(0, 1);
+            valueStr.pop_back();
+            if (valueStr.find('"') != std::string::npos) {
+                std::vector<std::string> strArray;
+                std::istringstream arrayStream(valueStr);
+                std::string element;
+                while (std::getline(arrayStream, element, ',')) {
+                    if (element.size() >= 2) {
+                        element = element.substr(1, element.size() - 2);
+                    }
+                    strArray.push_back(element);
+                }
+                return strArray;
+            }
+            std::vector<int> intArray;
+            std::istringstream arrayStream(valueStr);
+            std::string element;
+            while (std::getline(arrayStream, element, ',')) {
+                intArray.push_back(std::stoi(element));
+            }
+            return intArray;
+        }
+        if (valueStr == "true" || valueStr == "false") {
+            return valueStr == "true";
+        }
+        // Strings were written unquoted, so anything that is not entirely a number is one.
+        try {
+            size_t used = 0;
+            if (valueStr.find('.') != std::string::npos) {
+                double number = std::stod(valueStr, &used);
+                if (used == valueStr.size()) {
+                    return number;
+                }
+            } else {
+                int number = std::stoi(valueStr, &used);
+                if (used == valueStr.size()) {
+                    return number;
+                }
+            }
+        } catch (const std::logic_error&) {
+        }
+        return valueStr;
+    }
+
+    void saveVariablesToFile() {
+        std::string snapshot = Snapshot::header();
+        for (const auto& [name, variable] : variables) {
+            Snapshot::writeRecord(snapshot, Symbols::name(name), variable.value, variable.isConstant);
+        }
+        std::ofstream outFile(dataFileName, std::ios_base::binary);
+        outFile << snapshot;
+    }
+
+    void persistVariable(SymbolId name) {
+        dirtyVariables.insert(name);
+        ++pendingRecords;
+        switch (persistPolicy.mode) {
+            case PersistPolicy::Mode::Interval:
+                if (std::chrono::steady_clock::now() - lastFlush >= std::chrono::milliseconds(persistPolicy.amount)) {
+                    flushDirtyVariables();
+                }
+                break;
+            case PersistPolicy::Mode::Count:
+                if (pendingRecords >= static_cast<size_t>(persistPolicy.amount)) {
+                    flushDirtyVariables();
+                }
+                break;
+            case PersistPolicy::Mode::Exit:
+                break;
+        }
+    }
+
+    // Formats every dirty variable once, however often it was declared since the last batch.
+    void flushDirtyVariables() {
+        if (!dirtyVariables.empty()) {
+            std::string batch;
+            for (SymbolId name : dirtyVariables) {
+                const Variable& variable = variables[name];
+                Snapshot::writeRecord(batch, Symbols::name(name), variable.value, variable.isConstant);
+            }
+            writer.submit(std::move(batch));
+            dirtyVariables.clear();
+        }
+        pendingRecords = 0;
+        lastFlush = std::chrono::steady_clock::now();
+    }
+
+    void sync() {
+        flushDirtyVariables();
+        writer.wait();
+    }
+
+    // Functions provided by the interpreter itself. They are only called when no user-defined
+    // function of the same name exists.
+    Value callBuiltin(SymbolId name, const std::vector<Value>& arguments, int line) {
+        static const SymbolId SYNC = Symbols::intern("sync");
+        if (name == SYNC) {
+            if (!arguments.empty()) {
+                throw std::runtime_error("Function sync expects 0 arguments at line " + std::to_string(line));
+            }
+            sync();
+            return 0;
+        }
+        throw std::runtime_error("Undefined function: " + Symbols::name(name) + " at line " + std::to_string(line));
+    }
+
+    Value evaluateBinaryExpression(NodeId expr);
+    Value evaluateReadExpression(NodeId expr);
+    Value evaluateIndexExpression(NodeId expr);
+    Value evaluateArrayExpression(NodeId expr);
+    Value evaluateFunctionCallExpression(NodeId expr);
+    Value evaluateUnaryExpression(NodeId expr);
+
+    Value handleAssignment(NodeId expr, const Value& right);
+    Value handleArrayAssignment(NodeId indexExpr, const Value& right);
+    Value handleAddition(const Value& left, const Value& right);
+    Value handleSubtraction(const Value& left, const Value& right);
+    Value handleMultiplication(const Value& left, const Value& right);
+    Value handleDivision(const Value& left, const Value& right);
+    Value handleLessThan(const Value& left, const Value& right);
+    Value handleGreaterThan(const Value& left, const Value& right);
+    Value handleLessThanOrEqual(const Value& left, const Value& right);
+    Value handleGreaterThanOrEqual(const Value& left, const Value& right);
+    Value handleEqual(const Value& left, const Value& right);
+    Value handleNotEqual(const Value& left, const Value& right);
+    Value handlePower(const Value& left, const Value& right);
+    Value handleNegate(const Value& operand);
+    Value handleNot(const Value& operand);
+
+    template <typename Operation>
+    Value applyNumeric(const char* op, const Value& left, const Value& right, Operation operation);
+    template <typename T>
+    static Value applyKnown(Op op, T left, T right);
+
+    Value indexValue(const Value& container, const Value& index, int line);
+    void storeIndex(Value& container, const Value& index, const Value& value, int line);
+    Value makeArray(std::vector<Value> elements, int line);
+    Value readValue(const std::optional<Value>& prompt);
+    Value stepValue(Value& value, SymbolId name, int delta);
+
+    static bool isTrue(const Value& condition);
+
+    bool isNumber(const std::string& s);
+    bool isDouble(const std::string& s);
+
+    static void printValue(const Value& value);
+
+};
+
+Completion Interpreter::execute(NodeId statement) {
+    try {
+        switch (ast->kinds[statement]) {
+            case NodeKind::WriteStatement: {
+                auto value = evaluate(ast->a[statement]);
+                printValue(value);
+                break;
+            }
+            case NodeKind::VariableDeclaration: {
+                SymbolId name = ast->a[statement];
+                bool isConstant = (ast->flags[statement] & FlatAst::IS_CONSTANT) != 0;
+                int slot = static_cast<int>(ast->c[statement]);
+                bool isLocal = (ast->flags[statement] & FlatAst::IS_LOCAL) != 0;
+                if (!isLocal) {
+                    Variable* existing = findGlobal(slot);
+                    if (existing && existing->isConstant) {
+                        throw std::runtime_error("Cannot reassign constant variable: " + Symbols::name(name));
+                    }
+                }
+
+                Value value;
+                if (ast->b[statement] != NO_NODE) {
+                    value = evaluate(ast->b[statement]);
+                } else {
+                    value = 0;
+                }
+                if (isLocal) {
+                    locals[frameBase + slot] = std::move(value);
+                } else {
+                    Variable& variable = variables[name];
+                    variable = { std::move(value), isConstant };
+                    globals[slot] = &variable;
+                    persistVariable(name);
+                }
+                break;
+            }
+            case NodeKind::ExpressionStatement:
+                evaluate(ast->a[statement]);
+                break;
+            case NodeKind::FunctionDeclaration: {
+                uint32_t function = ast->a[statement];
+                functions[ast->functions[function].name] = { ast, function };
+                break;
+            }
+            case NodeKind::IfStatement:
+                if (isTrue(evaluate(ast->a[statement]))) {
+                    return execute(ast->b[statement]);
+                } else if (ast->c[statement] != NO_NODE) {
+                    return execute(ast->c[statement]);
+                }
+                break;
+            case NodeKind::ForStatement: {
+                const NodeId* parts = &ast->children[ast->a[statement]];
+                NodeId initializer = parts[0], condition = parts[1], increment = parts[2], body = parts[3];
+                execute(initializer);
+                while (isTrue(evaluate(condition))) {
+                    if (execute(body) == Completion::Return) {
+                        return Completion::Return;
+                    }
+                    execute(increment);
+                }
+                break;
+            }
+            case NodeKind::WhileStatement: {
+                NodeId condition = ast->a[statement], body = ast->b[statement];
+                while (isTrue(evaluate(condition))) {
+                    if (execute(body) == Completion::Return) {
+                        return Completion::Return;
+                    }
+                }
+                break;
+            }
+            case NodeKind::ReturnStatement:
+                returnValue = evaluate(ast->a[statement]);
+                return Completion::Return;
+            case NodeKind::BlockStatement:
+                for (uint32_t i = ast->a[statement], end = i + ast->b[statement]; i < end; ++i) {
+                    if (execute(ast->children[i]) == Completion::Return) {
+                        return Completion::Return;
+                    }
+                }
+                break;
+            case NodeKind::IncludeStatement: {
+                std::optional<ParsedFile> module = modules.include(Symbols::name(ast->a[statement]));
+                if (!module) {
+                    break; // already loaded
+                }
+                try {
+                    interpret(std::move(*module));
+                } catch (const std::exception& e) {
+                    throw std::runtime_error("Error in included file: " + std::string(e.what()));
+                }
+                break;
+            }
+            default:
+                throw std::runtime_error("Unsupported statement at line " + std::to_string(ast->lines[statement]));
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error executing statement: " << e.what() << std::endl;
+    }
+    return Completion::Normal;
+}
+
+Value Interpreter::evaluate(NodeId expr) {
+    switch (ast->kinds[expr]) {
+        case NodeKind::NumberExpression:
+            if (ast->flags[expr] & FlatAst::IS_DOUBLE) {
+                return ast->doubleValue(expr);
+            }
+            return static_cast<int>(ast->a[expr]);
+        case NodeKind::StringExpression:
+            return Symbols::name(ast->a[expr]);
+        case NodeKind::BoolExpression:
+            return ast->a[expr] != 0;
+        case NodeKind::VariableExpression:
+            if (ast->flags[expr] & FlatAst::IS_LOCAL) {
+                return locals[frameBase + ast->b[expr]];
+            } else if (const Variable* variable = findGlobal(static_cast<int>(ast->b[expr]))) {
+                return variable->value;
+            }
+            throw std::runtime_error("Undefined variable: " + Symbols::name(ast->a[expr]));
+        case NodeKind::BinaryExpression:
+            return evaluateBinaryExpression(expr);
+        case NodeKind::ReadExpression:
+            return evaluateReadExpression(expr);
+        case NodeKind::IndexExpression:
+            return evaluateIndexExpression(expr);
+        case NodeKind::ArrayExpression:
+            return evaluateArrayExpression(expr);
+        case NodeKind::FunctionCallExpression:
+            return evaluateFunctionCallExpression(expr);
+        case NodeKind::UnaryExpression:
+            return evaluateUnaryExpression(expr);
+        default:
+            break;
+    }
+
+    throw std::runtime_error("Unsupported expression type at line " + std::to_string(ast->lines[expr]));
+}
+
+Value Interpreter::evaluateBinaryExpression(NodeId expr) {
+    Op op = ast->ops[expr];
+    if (op == Op::Assign) {
+        auto right = evaluate(ast->b[expr]);
+        NodeId target = ast->a[expr];
+        if (ast->kinds[target] == NodeKind::IndexExpression) {
+            return handleArrayAssignment(target, right);
+        }
+        return handleAssignment(expr, right);
+    }
+
+    auto left = evaluate(ast->a[expr]);
+    auto right = evaluate(ast->b[expr]);
+    if (ast->flags[expr] & FlatAst::INT_OPERANDS) {
+        return applyKnown(op, left.asInt(), right.asInt());
+    }
+    if (ast->flags[expr] & FlatAst::DOUBLE_OPERANDS) {
+        return applyKnown(op, left.asDouble(), right.asDouble());
+    }
+
+    switch (op) {
+        case Op::Add: return handleAddition(left, right);
+        case Op::Subtract: return handleSubtraction(left, right);
+        case Op::Multiply: return handleMultiplication(left, right);
+        case Op::Divide: return handleDivision(left, right);
+        case Op::Less: return handleLessThan(left, right);
+        case Op::Greater: return handleGreaterThan(left, right);
+        case Op::LessEqual: return handleLessThanOrEqual(left, right);
+        case Op::GreaterEqual: return handleGreaterThanOrEqual(left, right);
+        case Op::Equal: return handleEqual(left, right);
+        case Op::NotEqual: return handleNotEqual(left, right);
+        case Op::Power: return handlePower(left, right);
+        default: break;
+    }
+
+    throw std::runtime_error(std::string("Unsupported operator: ") + opName(op) + " at line " + std::to_string(ast->lines[expr]));
+}
+
+Value Interpreter::evaluateUnaryExpression(NodeId expr) {
+    Op op = ast->ops[expr];
+    if (op == Op::Subtract) {
+        return handleNegate(evaluate(ast->a[expr]));
+    }
+    if (op == Op::Not) {
+        return handleNot(evaluate(ast->a[expr]));
+    }
+
+    NodeId varExpr = ast->a[expr];
+    if (ast->kinds[varExpr] != NodeKind::VariableExpression || (op != Op::Increment && op != Op::Decrement)) {
+        throw std::runtime_error(std::string("Unsupported unary operator: ") + opName(op) + " at line " + std::to_string(ast->lines[expr]));
+    }
+    Value& target = assignableValue(varExpr);
+    Value previous = stepValue(target, ast->a[varExpr], op == Op::Increment ? 1 : -1);
+    return (ast->flags[expr] & FlatAst::IS_PREFIX) ? target : previous;
+}
+
+Value Interpreter::evaluateReadExpression(NodeId expr) {
+    if (ast->a[expr] != NO_NODE) {
+        return readValue(evaluate(ast->a[expr]));
+    }
+    return readValue(std::nullopt);
+}
+
+Value Interpreter::evaluateIndexExpression(NodeId expr) {
+    auto container = evaluate(ast->a[expr]);
+    auto index = evaluate(ast->b[expr]);
+    return indexValue(container, index, ast->lines[expr]);
+}
+
+Value Interpreter::evaluateArrayExpression(NodeId expr) {
+    std::vector<Value> elements;
+    for (uint32_t i = ast->a[expr], end = i + ast->b[expr]; i < end; ++i) {
+        elements.push_back(evaluate(ast->children[i]));
+    }
+    return makeArray(std::move(elements), ast->lines[expr]);
+}
+
+Value Interpreter::evaluateFunctionCallExpression(NodeId expr) {
+    SymbolId name = ast->a[expr];
+    uint32_t firstArgument = ast->b[expr];
+    uint32_t argumentCount = ast->c[expr];
+    int line = ast->lines[expr];
+    auto it = functions.find(name);
+    if (it == functions.end()) {
+        std::vector<Value> arguments;
+        for (uint32_t i = 0; i < argumentCount; ++i) {
+            arguments.push_back(evaluate(ast->children[firstArgument + i]));
+        }
+        return callBuiltin(name, arguments, line);
+    }
+    FunctionRef function = it->second;
+    const FlatAst::Function& declared = function.ast->functions[function.index];
+    if (declared.parameterCount != argumentCount) {
+        throw std::runtime_error("Function " + Symbols::name(name) + " expects " + std::to_string(declared.parameterCount) +
+                                 " arguments at line " + std::to_string(line));
+    }
+    if (declared.isLazy()) {
+        parseFunctionBody(function);
+    }
+
+    // Arguments become the first slots of the callee's frame.
+    size_t base = locals.size();
+    try {
+        for (uint32_t i = 0; i < argumentCount; ++i) {
+            auto value = evaluate(ast->children[firstArgument + i]);
+            locals.push_back(std::move(value));
+        }
+    } catch (...) {
+        locals.resize(base);
+        throw;
+    }
+    // Read after the arguments ran: a call among them may have appended to the callee's tree.
+    const FlatAst::Function& callee = function.ast->functions[function.index];
+    uint32_t body = callee.body;
+    uint32_t bodyEnd = body + callee.bodyCount;
+    locals.resize(base + callee.slotCount);
+
+    FlatAst* callerAst = ast;
+    size_t callerBase = frameBase;
+    ast = function.ast;
+    frameBase = base;
+    Value result = 0;
+    for (uint32_t i = body; i < bodyEnd; ++i) {
+        if (execute(ast->children[i]) == Completion::Return) {
+            result = std::move(returnValue);
+            break;
+        }
+    }
+    ast = callerAst;
+    frameBase = callerBase;
+    locals.resize(base);
+    return result;
+}
+
+Value Interpreter::handleAssignment(NodeId expr, const Value& right) {
+    NodeId varExpr = ast->a[expr];
+    if (ast->kinds[varExpr] != NodeKind::VariableExpression) {
+        throw std::runtime_error("Invalid assignment target at line " + std::to_string(ast->lines[expr]));
+    }
+    assignableValue(varExpr) = right;
+    return right;
+}
+
+Value Interpreter::handleArrayAssignment(NodeId indexExpr, const Value& right) {
+    NodeId varExpr = ast->a[indexExpr];
+    if (ast->kinds[varExpr] != NodeKind::VariableExpression) {
+        throw std::runtime_error("Invalid assignment target at line " + std::to_string(ast->lines[indexExpr]));
+    }
+    auto index = evaluate(ast->b[indexExpr]);
+    storeIndex(assignableValue(varExpr), index, right, ast->lines[indexExpr]);
+    return right;
+}
+
+void Interpreter::parseFunctionBody(const FunctionRef& function) {
+    FlatAstBuilder(*function.ast).parseLazyBody(function.index);
+    resolver.resolveFunction(*function.ast, function.index);
+    globals.resize(resolver.globalNames().size(), nullptr);
+}
+
+Interpreter::Variable* Interpreter::findGlobal(int slot) {
+    Variable*& cached = globals[slot];
+    if (!cached) {
+        auto it = variables.find(resolver.globalNames()[slot]);
+        if (it != variables.end()) {
+            cached = &it->second;
+        }
+    }
+    return cached;
+}
+
+Value& Interpreter::assignableValue(NodeId varExpr) {
+    if (ast->flags[varExpr] & FlatAst::IS_LOCAL) {
+        return locals[frameBase + ast->b[varExpr]]; // constness of locals is checked by the Resolver
+    }
+    Variable* variable = findGlobal(static_cast<int>(ast->b[varExpr]));
+    if (!variable) {
+        throw std::runtime_error("Undefined variable: " + Symbols::name(ast->a[varExpr]));
+    }
+    if (variable->isConstant) {
+        throw std::runtime_error("Cannot reassign constant variable: " + Symbols::name(ast->a[varExpr]));
+    }
+    return variable->value;
+}
+
+template <typename Operation>
+Value Interpreter::applyNumeric(const char* op, const Value& left, const Value& right, Operation operation) {
+    if (left.isInt() && right.isInt()) {
+        return operation(left.asInt(), right.asInt());
+    }
+    if (!left.isNumber() || !right.isNumber()) {
+        throw std::runtime_error(std::string("Unsupported operand types for '") + op + "'");
+    }
+    return operation(left.asNumber(), right.asNumber());
+}
+
+// An operator TypeInference found two ints or two doubles for, computed as the handlers below
+// would for those types.
+template <typename T>
+Value Interpreter::applyKnown(Op op, T left, T right) {
+    switch (op) {
+        case Op::Add: return Arithmetic::add(left, right);
+        case Op::Subtract: return Arithmetic::subtract(left, right);
+        case Op::Multiply: return Arithmetic::multiply(left, right);
+        case Op::Divide:
+            if (right == 0) {
+                throw std::runtime_error("Division by zero");
+            }
+            return Arithmetic::divide(left, right);
+        case Op::Less: return left < right;
+        case Op::Greater: return left > right;
+        case Op::LessEqual: return left <= right;
+        case Op::GreaterEqual: return left >= right;
+        case Op::Equal: return left == right;
+        case Op::NotEqual: return left != right;
+        default: break;
+    }
+    throw std::runtime_error(std::string("Unsupported operator: ") + opName(op));
+}
+
+Value Interpreter::handleAddition(const Value& left, const Value& right) {
+    if (left.isString() || right.isString()) {
+        return left.toString() + right.toString();
+    }
+    if (left.isIntArray() && right.isIntArray()) {
+        auto result = left.asIntArray();
+        const auto& tail = right.asIntArray();
+        result.insert(result.end(), tail.begin(), tail.end());
+        return result;
+    }
+    if (left.isStringArray() && right.isStringArray()) {
+        auto result = left.asStringArray();
+        const auto& tail = right.asStringArray();
+        result.insert(result.end(), tail.begin(), tail.end());
+        return result;
+    }
+    return applyNumeric("+", left, right, [](auto a, auto b) { return Arithmetic::add(a, b); });
+}
+
+Value Interpreter::handleSubtraction(const Value& left, const Value& right) {
+    return applyNumeric("-", left, right, [](auto a, auto b) { return Arithmetic::subtract(a, b); });
+}
+
+Value Interpreter::handleMultiplication(const Value& left, const Value& right) {
+    return applyNumeric("*", left, right, [](auto a, auto b) { return Arithmetic::multiply(a, b); });
+}
+
+Value Interpreter::handleDivision(const Value& left, const Value& right) {
+    return applyNumeric("/", left, right, [](auto a, auto b) {
+        if (b == 0) {
+            throw std::runtime_error("Division by zero");
+        }
+        return Arithmetic::divide(a, b);
+    });
+}
+
+Value Interpreter::handleLessThan(const Value& left, const Value& right) {
+    if (left.isString() && right.isString()) {
+        return left.asString() < right.asString();
+    }
+    return applyNumeric("<", left, right, [](auto a, auto b) { return a < b; });
+}
+
+Value Interpreter::handleGreaterThan(const Value& left, const Value& right) {
+    if (left.isString() && right.isString()) {
+        return left.asString() > right.asString();
+    }
+    return applyNumeric(">", left, right, [](auto a, auto b) { return a > b; });
+}
+
+Value Interpreter::handleLessThanOrEqual(const Value& left, const Value& right) {
+    if (left.isString() && right.isString()) {
+        return left.asString() <= right.asString();
+    }
+    return applyNumeric("<=", left, right, [](auto a, auto b) { return a <= b; });
+}
+
+Value Interpreter::handleGreaterThanOrEqual(const Value& left, const Value& right) {
+    if (left.isString() && right.isString()) {
+        return left.asString() >= right.asString();
+    }
+    return applyNumeric(">=", left, right, [](auto a, auto b) { return a >= b; });
+}
+
+Value Interpreter::handleEqual(const Value& left, const Value& right) {
+    if (left.isNumber() && right.isNumber()) {
+        return applyNumeric("==", left, right, [](auto a, auto b) { return a == b; });
+    }
+    return left == right;
+}
+
+Value Interpreter::handleNotEqual(const Value& left, const Value& right) {
+    return !handleEqual(left, right).asBool();
+}
+
+// An int raised to a non-negative int stays an int, wrapping around like the other int operators
+// (see Arithmetic); every other numeric combination goes through std::pow.
+Value Interpreter::handlePower(const Value& left, const Value& right) {
+    if (left.isInt() && right.isInt() && right.asInt() >= 0) {
+        uint32_t base = static_cast<uint32_t>(left.asInt());
+        uint32_t result = 1;
+        for (uint32_t exponent = static_cast<uint32_t>(right.asInt()); exponent > 0; exponent >>= 1) {
+            if (exponent & 1) {
+                result *= base;
+            }
+            base *= base;
+        }
+        return static_cast<int>(result);
+    }
+    if (!left.isNumber() || !right.isNumber()) {
+        throw std::runtime_error("Unsupported operand types for '**'");
+    }
+    return std::pow(left.asNumber(), right.asNumber());
+}
+
+Value Interpreter::handleNegate(const Value& operand) {
+    if (operand.isInt()) {
+        return Arithmetic::negate(operand.asInt());
+    }
+    if (operand.isDouble()) {
+        return -operand.asDouble();
+    }
+    throw std::runtime_error("Unsupported operand type for '-'");
+}
+
+Value Interpreter::handleNot(const Value& operand) {
+    if (!operand.isBool()) {
+        throw std::runtime_error("Unsupported operand type for '!'");
+    }
+    return !operand.asBool();
+}
+
+Value Interpreter::indexValue(const Value& container, const Value& index, int line) {
+    if (!index.isInt()) {
+        throw std::runtime_error("Array index must be an integer at line " + std::to_string(line));
+    }
+    int i = index.asInt();
+    auto checkBounds = [&](size_t size) {
+        if (i < 0 || static_cast<size_t>(i) >= size) {
+            throw std::runtime_error("Array index out of bounds at line " + std::to_string(line));
+        }
+    };
+    switch (container.type()) {
+        case ValueType::IntArray:
+            checkBounds(container.asIntArray().size());
+            return container.asIntArray()[i];
+        case ValueType::StringArray:
+            checkBounds(container.asStringArray().size());
+            return container.asStringArray()[i];
+        case ValueType::String:
+            checkBounds(container.asString().size());
+            return std::string(1, container.asString()[i]);
+        default:
+            throw std::runtime_error("Cannot index a non-array value at line " + std::to_string(line));
+    }
+}
+
+void Interpreter::storeIndex(Value& container, const Value& index, const Value& value, int line) {
+    if (!index.isInt()) {
+        throw std::runtime_error("Array index must be an integer at line " + std::to_string(line));
+    }
+    int i = index.asInt();
+    auto checkBounds = [&](size_t size) {
+        if (i < 0 || static_cast<size_t>(i) >= size) {
+            throw std::runtime_error("Array index out of bounds at line " + std::to_string(line));
+        }
+    };
+    if (container.isIntArray()) {
+        checkBounds(container.asIntArray().size());
+        if (!value.isInt()) {
+            throw std::runtime_error("Array element type mismatch at line " + std::to_string(line));
+        }
+        container.mutableIntArray()[i] = value.asInt();
+    } else if (container.isStringArray()) {
+        checkBounds(container.asStringArray().size());
+        if (!value.isString()) {
+            throw std::runtime_error("Array element type mismatch at line " + std::to_string(line));
+        }
+        container.mutableStringArray()[i] = value.asString();
+    } else {
+        throw std::runtime_error("Cannot index a non-array value at line " + std::to_string(line));
+    }
+}
+
+Value Interpreter::makeArray(std::vector<Value> elements, int line) {
+    if (std::all_of(elements.begin(), elements.end(), [](const Value& e) { return e.isInt(); })) {
+        std::vector<int> ints;
+        ints.reserve(elements.size());
+        for (const auto& e : elements) ints.push_back(e.asInt());
+        return ints;
+    }
+    if (std::all_of(elements.begin(), elements.end(), [](const Value& e) { return e.isString(); })) {
+        std::vector<std::string> strings;
+        strings.reserve(elements.size());
+        for (const auto& e : elements) strings.push_back(e.asString());
+        return strings;
+    }
+    throw std::runtime_error("Array elements must all be integers or all be strings at line " + std::to_string(line));
+}
+
+Value Interpreter::readValue(const std::optional<Value>& prompt) {
+    if (prompt) {
+        std::cout << *prompt;
+    }
+    std::string input;
+    std::getline(std::cin, input);
+    if (isNumber(input)) {
+        return std::stoi(input);
+    } else if (isDouble(input)) {
+        return std::stod(input);
+    }
+    return input;
+}
+
+Value Interpreter::stepValue(Value& value, SymbolId name, int delta) {
+    Value previous = value;
+    if (value.isInt()) {
+        value = Arithmetic::add(value.asInt(), delta);
+    } else if (value.isDouble()) {
+        value = value.asDouble() + delta;
+    } else {
+        throw std::runtime_error("Cannot increment non-numeric variable: " + Symbols::name(name));
+    }
+    return previous;
+}
+
+bool Interpreter::isTrue(const Value& condition) {
+    if (!condition.isBool()) {
+        throw std::runtime_error("Condition must be a boolean");
+    }
+    return condition.asBool();
+}
+
+bool Interpreter::isNumber(const std::string& s) {
+    return !s.empty() && std::find_if(s.begin(), s.end(), [](unsigned char c) { return !std::isdigit(c); }) == s.end();
+}
+
+bool Interpreter::isDouble(const std::string& s) {
+    std::istringstream iss(s);
+    double d;
+    iss >> d;
+    return iss.eof() && !iss.fail();
+}
+
+void Interpreter::printValue(const Value& value) {
+    std::cout << value << std::endl;
+}
@@ -1,201 +1,577 @@
-#include <iostream>
-#include <string>
-#include <vector>
-#include <cctype>
-#include <fstream>
-#include <unordered_set>
-
-enum class TokenType {
-    Keyword,
-    Identifier,
-    Number,
-    Operator,
-    Symbol,
-    StringLiteral,
-    EndOfFile,
-    Unknown
-};
-
-struct Token {
-    TokenType type;
-    std::string value;
-    int line;
-
-    Token(TokenType type, std::string value, int line) : type(type), value(std::move(value)), line(line) {}
-};
-
-class Lexer {
-public:
-    size_t position;
-    int line;
-    explicit Lexer(const std::string &source) : source(source), position(0), line(1) {}
-
-    Token getNextToken() {
-        while (position < source.size()) {
-            char currentChar = source[position];
-
-            if (isspace(currentChar)) {
-                if (currentChar == '\n') {
-                    ++line;
-                }
-                ++position;
-                continue;
-            }
-
-            if (currentChar == '/' && position + 1 < source.size() && source[position + 1] == '/') {
-                skipSingleLineComment();
-                continue;
-            }
-
-            if (isalpha(currentChar) || (currentChar & 0x80)) {
-                return lexIdentifierOrKeyword();
-            }
-
-            if (isdigit(currentChar)) {
-                return lexNumber();
-            }
-
-            if (isOperator(currentChar)) {
-                return lexOperator();
-            }
-
-            if (isSymbol(currentChar)) {
-                return lexSymbol();
-            }
-
-            if (currentChar == '\'' || currentChar == '"') {
-                return lexStringLiteral(currentChar);
-            }
-
-            throw std::runtime_error("Unknown keyword at line " + std::to_string(line));
-        }
-
-        return Token(TokenType::EndOfFile, "", line);
-    }
-
-    void registerIdentifier(const std::string &identifier) {
-        identifiers.insert(identifier);
-    }
-
-private:
-    std::string source;
-    std::unordered_set<std::string> identifiers;
-
-    void skipSingleLineComment() {
-        while (position < source.size() && source[position] != '\n') {
-            ++position;
-        }
-        if (position < source.size() && source[position] == '\n') {
-            ++line;
-            ++position;
-        }
-    }
-
-    Token lexIdentifierOrKeyword() {
-        size_t start = position;
-        while (position < source.size() && (isalnum(source[position]) || source[position] == '_' || (source[position] & 0x80))) {
-            ++position;
-        }
-        std::string value = source.substr(start, position - start);
-
-        if (isKeyword(value)) {
-            return Token(TokenType::Keyword, value, line);
-        }
-
-        if (identifiers.find(value) != identifiers.end()) {
-            return Token(TokenType::Identifier, value, line);
-        }
-
-        return Token(TokenType::Identifier, value, line);
-    }
-
-    Token lexNumber() {
-        size_t start = position;
-        bool hasDot = false;
-        while (position < source.size() && (isdigit(source[position]) || (source[position] == '.' && !hasDot))) {
-            if (source[position] == '.') hasDot = true;
-            ++position;
-        }
-        return Token(TokenType::Number, source.substr(start, position - start), line);
-    }
-
-    Token lexOperator() {
-        size_t start = position;
-        char currentChar = source[position];
-
-        if ((currentChar == '!' || currentChar == '=' || currentChar == '<' || currentChar == '>') &&
-            position + 1 < source.size() && source[position + 1] == '=') {
-            position += 2;
-            return Token(TokenType::Operator, source.substr(start, 2), line);
-        }
-
-        if ((currentChar == '+' || currentChar == '-' || currentChar == '*' || currentChar == '/') &&
-            position + 1 < source.size() && source[position + 1] == currentChar) {
-            position += 2;
-            return Token(TokenType::Operator, source.substr(start, 2), line);
-        }
-
-        if ((currentChar == '+' && source[position + 1] == '+') || (currentChar == '-' && source[position + 1] == '-')) {
-            position += 2;
-            return Token(TokenType::Operator, source.substr(start, 2), line);
-        }
-
-        return Token(TokenType::Operator, std::string(1, source[position++]), line);
-    }
-
-    Token lexSymbol() {
-        return Token(TokenType::Symbol, std::string(1, source[position++]), line);
-    }
-
-    Token lexStringLiteral(char quoteType) {
-        ++position; // consume the opening quote
-        size_t start = position;
-        std::string value;
-        while (position < source.size() && source[position] != quoteType) {
-            if (source[position] == '\\' && position + 1 < source.size()) {
-                ++position;
-                switch (source[position]) {
-                    case 'n': value += '\n'; break;
-                    case 't': value += '\t'; break;
-                    case '\\': value += '\\'; break;
-                    case '\'': value += '\''; break;
-                    case '"': value += '\"'; break;
-                    default: value += source[position]; break;
-                }
-            } else {
-                value += source[position];
-            }
-            ++position;
-        }
-
-        if (position >= source.size()) {
-            throw std::runtime_error("Unterminated string literal");
-        }
-
-        ++position; // consume the closing quote
-        return Token(TokenType::StringLiteral, value, line);
-    }
-
-    bool isKeyword(const std::string &str) const {
-        static const std::vector<std::string> keywords = {
-            "if", "else", "while", "return", "write", "read", "func", "for", "include", "let", "const"
-        };
-
-        for (const auto &keyword : keywords) {
-            if (str == keyword) {
-                return true;
-            }
-        }
-        return false;
-    }
-
-    bool isOperator(char ch) const {
-        static const std::string operators = "+-*/=!><";
-        return operators.find(ch) != std::string::npos;
-    }
-
-    bool isSymbol(char ch) const {
-        static const std::string symbols = "();{},[]";
-        return symbols.find(ch) != std::string::npos;
-    }
-};
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fstream>
+
+enum class TokenType {
+    Keyword,
+    Identifier,
+    Number,
+    Operator,
+    Symbol,
+    StringLiteral,
+    EndOfFile,
+    Unknown
+};
+
+enum class Keyword : uint8_t {
+    None,
+    If,
+    Else,
+    While,
+    Return,
+    Write,
+    Read,
+    Func,
+    For,
+    Include,
+    Let,
+    Const,
+    True,
+    False
+};
+
+enum class Op : uint8_t {
+    None,
+    Add,
+    Subtract,
+    Multiply,
+    Divide,
+    Power,
+    Assign,
+    Not,
+    Less,
+    Greater,
+    LessEqual,
+    GreaterEqual,
+    Equal,
+    NotEqual,
+    Increment,
+    Decrement
+};
+
+inline const char* opName(Op op) {
+    switch (op) {
+        case Op::Add: return "+";
+        case Op::Subtract: return "-";
+        case Op::Multiply: return "*";
+        case Op::Divide: return "/";
+        case Op::Power: return "**";
+        case Op::Assign: return "=";
+        case Op::Not: return "!";
+        case Op::Less: return "<";
+        case Op::Greater: return ">";
+        case Op::LessEqual: return "<=";
+        case Op::GreaterEqual: return ">=";
+        case Op::Equal: return "==";
+        case Op::NotEqual: return "!=";
+        case Op::Increment: return "++";
+        case Op::Decrement: return "--";
+        case Op::None: break;
+    }
+    return "?";
+}
+
+enum class Sym : uint8_t {
+    None,
+    LeftParen,
+    RightParen,
+    LeftBrace,
+    RightBrace,
+    LeftBracket,
+    RightBracket,
+    Comma,
+    Semicolon
+};
+
+// Character classes, looked up in a table instead of the locale-dependent <cctype> functions.
+enum CharClass : uint8_t {
+    CharSpace = 1 << 0,
+    CharIdentifierStart = 1 << 1, // letters and any byte of a UTF-8 sequence
+    CharIdentifier = 1 << 2,      // identifier starts, digits and '_'
+    CharDigit = 1 << 3,
+    CharOperator = 1 << 4,
+    CharSymbol = 1 << 5,
+    CharQuote = 1 << 6
+};
+
+constexpr std::array<uint8_t, 256> makeCharClasses() {
+    std::array<uint8_t, 256> classes{};
+    for (int ch = 0; ch < 256; ++ch) {
+        uint8_t charClass = 0;
+        if (ch == ' ' || (ch >= '\t' && ch <= '\r')) {
+            charClass |= CharSpace;
+        }
+        if ((ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || ch >= 0x80) {
+            charClass |= CharIdentifierStart | CharIdentifier;
+        }
+        if (ch >= '0' && ch <= '9') {
+            charClass |= CharDigit | CharIdentifier;
+        }
+        if (ch == '_') {
+            charClass |= CharIdentifier;
+        }
+        for (char op : std::string_view("+-*/=!><")) {
+            if (ch == op) {
+                charClass |= CharOperator;
+            }
+        }
+        for (char symbol : std::string_view("();{},[]")) {
+            if (ch == symbol) {
+                charClass |= CharSymbol;
+            }
+        }
+        if (ch == '\'' || ch == '"') {
+            charClass |= CharQuote;
+        }
+        classes[ch] = charClass;
+    }
+    return classes;
+}
+
+constexpr std::array<uint8_t, 256> charClasses = makeCharClasses();
+
+inline bool hasCharClass(char ch, uint8_t charClass) {
+    return (charClasses[static_cast<unsigned char>(ch)] & charClass) != 0;
+}
+
+// A token's value points into the lexer's source, or for string literals with escapes into
+// the symbol table, so it stays valid as long as the source does. Identifiers and string
+// literals also carry their interned `symbol`. Tokens of a streaming lexer are the exception;
+// see Lexer(InputStream&).
+struct Token {
+    TokenType type = TokenType::EndOfFile;
+    std::string_view value;
+    SymbolId symbol = 0;
+    size_t offset = 0;
+    int line = 0;
+    Keyword keyword = Keyword::None;
+    Op op = Op::None;
+    Sym sym = Sym::None;
+    bool isDouble = false; // for numbers: whether the value is in `real` rather than `integer`
+    int64_t integer = 0;
+    double real = 0;
+
+    Token() = default;
+    Token(TokenType type, std::string_view value, size_t offset, int line) : type(type), value(value), offset(offset), line(line) {}
+};
+
+// The lexer does not copy its source; the caller keeps the buffer (typically a MappedFile)
+// alive until parsing is done.
+class Lexer {
+public:
+    // Starts lexing at `position`, which is on line `line`; by default at the top of the source.
+    explicit Lexer(std::string_view source, size_t position = 0, int line = 1) : position(position), line(line), source(source) {}
+
+    // Lexes `input` as it arrives, holding only a window of it: the bytes from the token being
+    // lexed on, refilled a chunk at a time. A token cut off by the end of the window is lexed
+    // again once more input is in. Since the window moves, identifiers and string literals
+    // point into the symbol table and other tokens into copies the lexer keeps for its last
+    // RECENT_TOKENS tokens, more than the parser ever holds; offsets are within the window,
+    // so skipBlock() and lazily parsed bodies are not available.
+    explicit Lexer(InputStream& input) : input(&input) {}
+
+    Token getNextToken() {
+        if (!input) {
+            return lexToken();
+        }
+        for (;;) {
+            size_t start = position;
+            int startLine = line;
+            try {
+                Token token = lexToken();
+                if (position < source.size() || inputEnded) {
+                    return keepText(token);
+                }
+                if (token.type == TokenType::StringLiteral) {
+                    Symbols::release(token.symbol); // lexed again below
+                }
+            } catch (const std::runtime_error&) {
+                if (position < source.size() || inputEnded) {
+                    throw;
+                }
+            }
+            position = start;
+            line = startLine;
+            refill();
+        }
+    }
+
+    std::string_view text() const {
+        return source;
+    }
+
+    // Interns the text of a string literal; those of a stream only for as long as their
+    // statement is kept (see Symbols).
+    SymbolId internLiteral(std::string_view text) const {
+        return input ? Symbols::internTransient(text) : Symbols::intern(text);
+    }
+
+    // Moves past the '}' that closes the block whose '{' was the last token returned, without
+    // producing tokens for anything in between. String literals and comments are stepped over
+    // so that braces inside them do not count.
+    void skipBlock() {
+        int startLine = line;
+        int depth = 1;
+        while ((position = TextScan::findBlockByte(source, position)) < source.size()) {
+            char currentChar = source[position++];
+            switch (currentChar) {
+                case '\n':
+                    ++line;
+                    break;
+                case '{':
+                    ++depth;
+                    break;
+                case '}':
+                    if (--depth == 0) {
+                        return;
+                    }
+                    break;
+                case '/':
+                    if (position < source.size() && source[position] == '/') {
+                        skipSingleLineComment();
+                    }
+                    break;
+                case '\'':
+                case '"':
+                    while ((position = TextScan::findQuoteOrBackslash(source, position, currentChar)) < source.size() &&
+                           source[position] != currentChar) {
+                        position += 2; // a backslash and the character it escapes
+                    }
+                    ++position; // consume the closing quote
+                    break;
+            }
+        }
+        throw std::runtime_error("Unterminated block starting at line " + std::to_string(startLine));
+    }
+
+private:
+    static constexpr size_t CHUNK_SIZE = 64 * 1024;
+    static constexpr size_t RECENT_TOKENS = 8;
+
+    size_t position = 0;
+    int line = 1;
+    std::string_view source;
+
+    // Set for a streaming lexer; `source` is then a view of `window`.
+    InputStream* input = nullptr;
+    std::string window;
+    bool inputEnded = false;
+    std::array<std::string, RECENT_TOKENS> recentTexts;
+    size_t nextRecentText = 0;
+
+    // Drops the bytes before `position`, which have been lexed, and reads more after the rest.
+    // The read is at least as large as what is kept, so a token longer than a chunk takes a
+    // number of refills logarithmic in its length.
+    void refill() {
+        window.erase(0, position);
+        position = 0;
+        size_t kept = window.size();
+        size_t chunk = std::max(CHUNK_SIZE, kept);
+        window.resize(kept + chunk);
+        size_t count = input->read(&window[kept], chunk);
+        window.resize(kept + count);
+        inputEnded = count == 0;
+        source = window;
+    }
+
+    Token keepText(Token token) {
+        if (token.type == TokenType::Identifier || token.type == TokenType::StringLiteral) {
+            token.value = Symbols::name(token.symbol);
+        } else if (!token.value.empty()) {
+            std::string& text = recentTexts[nextRecentText];
+            nextRecentText = (nextRecentText + 1) % RECENT_TOKENS;
+            text.assign(token.value);
+            token.value = text;
+        }
+        return token;
+    }
+
+    Token lexToken() {
+        while (position < source.size()) {
+            char currentChar = source[position];
+
+            if (hasCharClass(currentChar, CharSpace)) {
+                if (currentChar == '\n') {
+                    ++line;
+                }
+                ++position;
+                // Most runs are one space between two tokens; longer ones are skipped in bulk.
+                if (position < source.size() && hasCharClass(source[position], CharSpace)) {
+                    position = TextScan::skipSpace(source, position, line);
+                }
+                continue;
+            }
+
+            if (currentChar == '/' && position + 1 < source.size() && source[position + 1] == '/') {
+                skipSingleLineComment();
+                continue;
+            }
+
+            if (hasCharClass(currentChar, CharIdentifierStart)) {
+                return lexIdentifierOrKeyword();
+            }
+
+            if (hasCharClass(currentChar, CharDigit)) {
+                return lexNumber();
+            }
+
+            if (hasCharClass(currentChar, CharOperator)) {
+                return lexOperator();
+            }
+
+            if (hasCharClass(currentChar, CharSymbol)) {
+                return lexSymbol();
+            }
+
+            if (hasCharClass(currentChar, CharQuote)) {
+                return lexStringLiteral(currentChar);
+            }
+
+            throw std::runtime_error("Unknown keyword at line " + std::to_string(line));
+        }
+
+        return Token(TokenType::EndOfFile, std::string_view(), position, line);
+    }
+
+    void skipSingleLineComment() {
+        position = TextScan::findNewline(source, position);
+        if (position < source.size() && source[position] == '\n') {
+            ++line;
+            ++position;
+        }
+    }
+
+    Token lexIdentifierOrKeyword() {
+        size_t start = position;
+        while (position < source.size() && hasCharClass(source[position], CharIdentifier)) {
+            ++position;
+        }
+        std::string_view value = source.substr(start, position - start);
+
+        Keyword keyword = findKeyword(value);
+        if (keyword != Keyword::None) {
+            Token token(TokenType::Keyword, value, start, line);
+            token.keyword = keyword;
+            return token;
+        }
+
+        Token token(TokenType::Identifier, value, start, line);
+        token.symbol = Symbols::intern(value);
+        return token;
+    }
+
+    // Integers are decimal, hexadecimal after "0x" or binary after "0b"; a decimal with a '.'
+    // is a double. Digits may be grouped with '_', which has to sit between two digits. The
+    // value is converted here, with std::from_chars, so parsing it is independent of the locale.
+    Token lexNumber() {
+        size_t start = position;
+        int base = 10;
+        if (source[position] == '0' && position + 1 < source.size()) {
+            char prefix = static_cast<char>(source[position + 1] | 0x20);
+            base = prefix == 'x' ? 16 : prefix == 'b' ? 2 : 10;
+            if (base != 10) {
+                position += 2;
+            }
+        }
+        size_t digits = position;
+        bool valid = skipDigits(base);
+        bool isDouble = base == 10 && position < source.size() && source[position] == '.';
+        if (isDouble) {
+            ++position; // the fraction may be empty, as in "1."
+            if (position < source.size() && (hasCharClass(source[position], CharDigit) || source[position] == '_')) {
+                valid = skipDigits(10) && valid;
+            }
+        }
+        std::string_view text = source.substr(start, position - start);
+        if (!valid || (position < source.size() && (hasCharClass(source[position], CharIdentifier) || source[position] == '.'))) {
+            throw std::runtime_error("Invalid number " + std::string(text) + " at line " + std::to_string(line));
+        }
+
+        std::string_view number = source.substr(digits, position - digits);
+        std::string withoutSeparators;
+        if (number.find('_') != std::string_view::npos) {
+            for (char ch : number) {
+                if (ch != '_') {
+                    withoutSeparators += ch;
+                }
+            }
+            number = withoutSeparators;
+        }
+
+        Token token(TokenType::Number, text, start, line);
+        token.isDouble = isDouble;
+        std::from_chars_result result = isDouble
+            ? std::from_chars(number.data(), number.data() + number.size(), token.real)
+            : std::from_chars(number.data(), number.data() + number.size(), token.integer, base);
+        if (result.ec != std::errc() || result.ptr != number.data() + number.size()) {
+            throw std::runtime_error("Number " + std::string(text) + " is too large at line " + std::to_string(line));
+        }
+        return token;
+    }
+
+    // Moves past a run of digits of `base` and the '_' between them. Returns false when the run
+    // is empty or a '_' is not between two digits.
+    bool skipDigits(int base) {
+        size_t start = position;
+        bool valid = true;
+        while (position < source.size()) {
+            char ch = source[position];
+            if (ch == '_') {
+                valid = valid && position > start && position + 1 < source.size() && isDigit(source[position + 1], base);
+            } else if (!isDigit(ch, base)) {
+                break;
+            }
+            ++position;
+        }
+        return valid && position > start;
+    }
+
+    static bool isDigit(char ch, int base) {
+        switch (base) {
+            case 2: return ch == '0' || ch == '1';
+            case 16: return hasCharClass(ch, CharDigit) || ((ch | 0x20) >= 'a' && (ch | 0x20) <= 'f');
+            default: return hasCharClass(ch, CharDigit);
+        }
+    }
+
+    Token lexOperator() {
+        size_t start = position;
+        char currentChar = source[position];
+        char nextChar = position + 1 < source.size() ? source[position + 1] : '\0';
+
+        Op op = Op::None;
+        if (nextChar == '=') {
+            switch (currentChar) {
+                case '!': op = Op::NotEqual; break;
+                case '=': op = Op::Equal; break;
+                case '<': op = Op::LessEqual; break;
+                case '>': op = Op::GreaterEqual; break;
+            }
+        } else if (nextChar == currentChar) {
+            switch (currentChar) {
+                case '+': op = Op::Increment; break;
+                case '-': op = Op::Decrement; break;
+                case '*': op = Op::Power; break;
+            }
+        }
+
+        size_t length = 2;
+        if (op == Op::None) {
+            length = 1;
+            switch (currentChar) {
+                case '+': op = Op::Add; break;
+                case '-': op = Op::Subtract; break;
+                case '*': op = Op::Multiply; break;
+                case '/': op = Op::Divide; break;
+                case '=': op = Op::Assign; break;
+                case '!': op = Op::Not; break;
+                case '<': op = Op::Less; break;
+                case '>': op = Op::Greater; break;
+            }
+        }
+
+        position += length;
+        Token token(TokenType::Operator, source.substr(start, length), start, line);
+        token.op = op;
+        return token;
+    }
+
+    Token lexSymbol() {
+        size_t start = position++;
+        Token token(TokenType::Symbol, source.substr(start, 1), start, line);
+        switch (source[start]) {
+            case '(': token.sym = Sym::LeftParen; break;
+            case ')': token.sym = Sym::RightParen; break;
+            case '{': token.sym = Sym::LeftBrace; break;
+            case '}': token.sym = Sym::RightBrace; break;
+            case '[': token.sym = Sym::LeftBracket; break;
+            case ']': token.sym = Sym::RightBracket; break;
+            case ',': token.sym = Sym::Comma; break;
+            case ';': token.sym = Sym::Semicolon; break;
+        }
+        return token;
+    }
+
+    Token lexStringLiteral(char quoteType) {
+        size_t tokenStart = position;
+        ++position; // consume the opening quote
+        size_t start = position;
+        position = TextScan::findQuoteOrBackslash(source, position, quoteType);
+        if (position < source.size() && source[position] == quoteType) {
+            ++position; // consume the closing quote
+            Token token(TokenType::StringLiteral, source.substr(start, position - 1 - start), tokenStart, line);
+            token.symbol = internLiteral(token.value);
+            return token;
+        }
+
+        // Only literals with escapes have to be copied before they are interned.
+        std::string value(source.substr(start, position - start));
+        while (position < source.size() && source[position] != quoteType) {
+            if (source[position] == '\\' && position + 1 < source.size()) {
+                ++position;
+                switch (source[position]) {
+                    case 'n': value += '\n'; break;
+                    case 't': value += '\t'; break;
+                    case '\\': value += '\\'; break;
+                    case '\'': value += '\''; break;
+                    case '"': value += '\"'; break;
+                    default: value += source[position]; break;
+                }
+                ++position;
+            } else {
+                size_t runEnd = TextScan::findQuoteOrBackslash(source, position + 1, quoteType);
+                value += source.substr(position, runEnd - position);
+                position = runEnd;
+            }
+        }
+
+        if (position >= source.size()) {
+            throw std::runtime_error("Unterminated string literal");
+        }
+
+        ++position; // consume the closing quote
+        SymbolId symbol = internLiteral(value);
+        Token token(TokenType::StringLiteral, Symbols::name(symbol), tokenStart, line);
+        token.symbol = symbol;
+        return token;
+    }
+
+    // Keywords are told apart by length first, so an identifier is compared with at most four
+    // keywords of exactly its length.
+    static Keyword findKeyword(std::string_view word) {
+        switch (word.size()) {
+            case 2:
+                if (word == "if") return Keyword::If;
+                break;
+            case 3:
+                if (word == "for") return Keyword::For;
+                if (word == "let") return Keyword::Let;
+                break;
+            case 4:
+                if (word == "else") return Keyword::Else;
+                if (word == "read") return Keyword::Read;
+                if (word == "func") return Keyword::Func;
+                if (word == "true") return Keyword::True;
+                break;
+            case 5:
+                if (word == "while") return Keyword::While;
+                if (word == "write") return Keyword::Write;
+                if (word == "const") return Keyword::Const;
+                if (word == "false") return Keyword::False;
+                break;
+            case 6:
+                if (word == "return") return Keyword::Return;
+                break;
+            case 7:
+                if (word == "include") return Keyword::Include;
+                break;
+        }
+        return Keyword::None;
+    }
+};
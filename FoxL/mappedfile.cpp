@@ -0,0 +1,78 @@
+#include <cstddef>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <string_view>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define FOXL_HAVE_MMAP 1
+#endif
+
+// A read-only view of a whole file. Where mmap is available the file is mapped instead of
+// copied; elsewhere it is read into a buffer owned by the object. Like std::ifstream, a file
+// that cannot be opened leaves the object closed instead of throwing.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& fileName) {
+#ifdef FOXL_HAVE_MMAP
+        int fd = ::open(fileName.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return;
+        }
+        struct stat info;
+        if (::fstat(fd, &info) == 0 && S_ISREG(info.st_mode)) {
+            opened = true;
+            length = static_cast<size_t>(info.st_size);
+            if (length > 0) {
+                void* mapping = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (mapping != MAP_FAILED) {
+                    bytes = static_cast<const char*>(mapping);
+                    mapped = true;
+                } else {
+                    opened = false;
+                    length = 0;
+                }
+            }
+        }
+        ::close(fd);
+        if (opened) {
+            return;
+        }
+#endif
+        std::ifstream file(fileName, std::ios_base::binary);
+        if (!file) {
+            return;
+        }
+        buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        opened = true;
+        bytes = buffer.data();
+        length = buffer.size();
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+#ifdef FOXL_HAVE_MMAP
+        if (mapped) {
+            ::munmap(const_cast<char*>(bytes), length);
+        }
+#endif
+    }
+
+    bool isOpen() const { return opened; }
+    const char* data() const { return bytes; }
+    size_t size() const { return length; }
+    std::string_view view() const { return std::string_view(bytes, length); }
+
+private:
+    std::string buffer;
+    const char* bytes = "";
+    size_t length = 0;
+    bool opened = false;
+    bool mapped = false;
+};
@@ -0,0 +1,191 @@
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Every file a process includes, keyed by canonical path. A module is read and parsed once
+// and runs only on its first include, however often and from wherever it is included; this
+// also ends include cycles. With revalidation on, a module whose modification time changed
+// since it was loaded is parsed and run again at its next include; from its first change on, a
+// module is kept in an IncrementalParser, so later changes are parsed only where the file
+// changed. With lazy functions, a module's file stays mapped for as long as its tree, since
+// unparsed bodies point into it; revalidation expects files to change underneath, so it turns
+// lazy parsing off for modules.
+class ModuleRegistry {
+public:
+    explicit ModuleRegistry(bool revalidate = false, bool lazyFunctions = false)
+        : revalidate(revalidate), lazyFunctions(lazyFunctions && !revalidate) {}
+
+    // Records a file that is already running, such as the main script, so including it does
+    // not run it a second time.
+    void markLoaded(const std::string& fileName) {
+        std::string path = canonicalPath(fileName);
+        modules[path] = modificationTime(path);
+    }
+
+    // Parses the files included at the top level of `statements`, the files included at the
+    // top level of those, and so on, on a pool of threads, so that include() finds them ready.
+    // A file that cannot be read or parsed is not reported here but by the include() that
+    // needs it, exactly as if that include had parsed it itself.
+    void preload(const FlatAst& ast, const std::vector<NodeId>& statements) {
+        std::mutex mutex;
+        std::condition_variable changed;
+        std::deque<std::string> queue; // file names as written in the include statements
+        std::unordered_set<std::string> queued; // canonical paths
+        size_t busy = 0;
+
+        auto enqueueIncludes = [&](const FlatAst& parsedAst, const std::vector<NodeId>& parsedStatements) {
+            for (NodeId stmt : parsedStatements) {
+                if (parsedAst.kinds[stmt] == NodeKind::IncludeStatement) {
+                    const std::string& fileName = Symbols::name(parsedAst.a[stmt]);
+                    std::string path = canonicalPath(fileName);
+                    if (modules.count(path) == 0 && queued.insert(path).second) {
+                        queue.push_back(fileName);
+                    }
+                }
+            }
+        };
+
+        auto work = [&] {
+            std::unique_lock<std::mutex> lock(mutex);
+            for (;;) {
+                changed.wait(lock, [&] { return !queue.empty() || busy == 0; });
+                if (queue.empty()) {
+                    return; // nothing queued and nothing being parsed that could queue more
+                }
+                std::string fileName = std::move(queue.front());
+                queue.pop_front();
+                ++busy;
+                lock.unlock();
+
+                std::string path = canonicalPath(fileName);
+                Loaded loaded = load(fileName, path, modificationTime(path), lazyFunctions);
+
+                lock.lock();
+                --busy;
+                enqueueIncludes(loaded.parsed.ast, loaded.parsed.statements);
+                preloaded[path] = std::move(loaded);
+                changed.notify_all();
+            }
+        };
+
+        enqueueIncludes(ast, statements);
+        if (queue.empty()) {
+            return;
+        }
+        std::vector<std::thread> workers;
+        unsigned threadCount = std::max(1u, std::thread::hardware_concurrency());
+        for (unsigned i = 1; i < threadCount; ++i) {
+            workers.emplace_back(work);
+        }
+        work();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    // Returns the tree an include of `fileName` has to run, or nothing when the module is
+    // already loaded and up to date. The caller owns the tree from then on, and has to keep it
+    // for as long as anything it runs still points into it.
+    std::optional<ParsedFile> include(const std::string& fileName) {
+        std::string path = canonicalPath(fileName);
+        auto modified = modificationTime(path);
+        auto it = modules.find(path);
+        if (it != modules.end() && (!revalidate || it->second == modified)) {
+            return std::nullopt;
+        }
+
+        if (it != modules.end()) {
+            ParsedFile parsed = reparse(fileName, path);
+            modules[path] = modified;
+            return parsed;
+        }
+
+        Loaded loaded;
+        auto ready = preloaded.find(path);
+        if (ready != preloaded.end() && ready->second.modified == modified) {
+            loaded = std::move(ready->second);
+            preloaded.erase(ready);
+        } else {
+            loaded = load(fileName, path, modified, lazyFunctions);
+        }
+        if (!loaded.error.empty()) {
+            throw std::runtime_error(loaded.error);
+        }
+        modules[path] = modified;
+        return std::move(loaded.parsed);
+    }
+
+private:
+    struct Loaded {
+        ParsedFile parsed;
+        std::filesystem::file_time_type modified;
+        std::string error; // the message include() reports, empty on success
+    };
+
+    bool revalidate;
+    bool lazyFunctions;
+    std::unordered_map<std::string, std::filesystem::file_time_type> modules; // modification time when loaded
+    std::unordered_map<std::string, Loaded> preloaded;
+    std::unordered_map<std::string, IncrementalParser> changed; // modules that changed since their first load
+
+    static std::string canonicalPath(const std::string& fileName) {
+        std::error_code error;
+        std::filesystem::path path = std::filesystem::weakly_canonical(fileName, error);
+        return error ? fileName : path.string();
+    }
+
+    std::filesystem::file_time_type modificationTime(const std::string& path) const {
+        std::error_code error;
+        return revalidate ? std::filesystem::last_write_time(path, error) : std::filesystem::file_time_type();
+    }
+
+    // Parses a module again after it changed on disk.
+    ParsedFile reparse(const std::string& fileName, const std::string& path) {
+        MappedFile file(path);
+        if (!file.isOpen()) {
+            throw std::runtime_error("Error: Could not open include file " + fileName);
+        }
+        try {
+            auto it = changed.find(path);
+            if (it == changed.end()) {
+                it = changed.emplace(path, IncrementalParser(std::string(file.view()))).first;
+            } else {
+                it->second.update(file.view());
+            }
+            return it->second.parsedFile();
+        } catch (const std::exception& e) {
+            throw std::runtime_error("Error in included file " + fileName + ": " + e.what());
+        }
+    }
+
+    // Reads and parses one module. Safe to run on several threads at once.
+    static Loaded load(const std::string& fileName, const std::string& path, std::filesystem::file_time_type modified,
+                       bool lazyFunctions) {
+        Loaded loaded;
+        loaded.modified = modified;
+        auto file = std::make_unique<MappedFile>(path);
+        if (!file->isOpen()) {
+            loaded.error = "Error: Could not open include file " + fileName;
+            return loaded;
+        }
+        try {
+            loaded.parsed = CompileCache::parse(path, file->view(), lazyFunctions);
+            if (lazyFunctions) {
+                loaded.parsed.source = std::move(file);
+            }
+        } catch (const std::exception& e) {
+            loaded.error = "Error in included file " + fileName + ": " + e.what();
+        }
+        return loaded;
+    }
+};
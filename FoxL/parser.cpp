@@ -1,752 +1,1138 @@
-#include <memory>
-#include <vector>
-#include <iostream>
-#include <string>
-#include <utility>
-
-class ASTNode {
-public:
-    int line;
-    virtual ~ASTNode() = default;
-    virtual void print() const = 0;
-    ASTNode(int line) : line(line) {}
-};
-
-class Expression : public ASTNode {
-public:
-    std::string name;
-    using ASTNode::ASTNode;
-
-    Expression(int line) : ASTNode(line), name("") {}
-    Expression(std::string name, int line) : ASTNode(line), name(std::move(name)) {}
-};
-
-class Statement : public ASTNode {
-public:
-    using ASTNode::ASTNode;
-};
-
-class WriteStatement : public Statement {
-public:
-    std::unique_ptr<Expression> messageExpr;
-
-    explicit WriteStatement(std::unique_ptr<Expression> messageExpr, int line)
-        : Statement(line), messageExpr(std::move(messageExpr)) {}
-
-    void print() const override {
-        std::cout << "WriteStatement(";
-        messageExpr->print();
-        std::cout << ", line: " << line << ")" << std::endl;
-    }
-};
-
-class ReadExpression : public Expression {
-public:
-    std::unique_ptr<Expression> prompt;
-
-    ReadExpression(std::unique_ptr<Expression> prompt, int line)
-        : Expression(line), prompt(std::move(prompt)) {}
-
-    void print() const override {
-        std::cout << "ReadExpression(";
-        if (prompt) {
-            prompt->print();
-        }
-        std::cout << ", line: " << line << ")" << std::endl;
-    }
-};
-
-class VariableDeclaration : public Statement {
-public:
-    std::string type;
-    std::string name;
-    std::unique_ptr<Expression> initializer;
-
-    VariableDeclaration(std::string type, std::string name, std::unique_ptr<Expression> initializer, int line)
-        : Statement(line), type(std::move(type)), name(std::move(name)), initializer(std::move(initializer)) {}
-
-    void print() const override {
-        std::cout << "VariableDeclaration(" << type << " " << name << ", line: " << line << ")" << std::endl;
-        if (initializer) {
-            initializer->print();
-        }
-    }
-};
-
-class NumberExpression : public Expression {
-public:
-    double value;
-
-    NumberExpression(double value, int line) : Expression(line), value(value) {}
-
-    void print() const override {
-        std::cout << "NumberExpression(" << value << ", line: " << line << ")" << std::endl;
-    }
-};
-
-class StringExpression : public Expression {
-public:
-    std::string value;
-
-    StringExpression(std::string value, int line) : Expression(line), value(std::move(value)) {}
-
-    void print() const override {
-        std::cout << "StringExpression(" << value << ", line: " << line << ")" << std::endl;
-    }
-};
-
-class BoolExpression : public Expression {
-public:
-    bool value;
-
-    BoolExpression(bool value, int line) : Expression(line), value(value) {}
-
-    void print() const override {
-        std::cout << "BoolExpression(" << value << ", line: " << line << ")" << std::endl;
-    }
-};
-
-class ArrayExpression : public Expression {
-public:
-    std::vector<std::unique_ptr<Expression>> elements;
-
-    ArrayExpression(std::vector<std::unique_ptr<Expression>> elements, int line)
-        : Expression(line), elements(std::move(elements)) {}
-
-    void print() const override {
-        std::cout << "ArrayExpression, line: " << line << std::endl;
-        for (const auto& elem : elements) {
-            elem->print();
-        }
-    }
-};
-
-class VariableExpression : public Expression {
-public:
-    VariableExpression(std::string name, int line) : Expression(std::move(name), line) {}
-
-    void print() const override {
-        std::cout << "VariableExpression(" << name << ", line: " << line << ")" << std::endl;
-    }
-};
-
-class BinaryExpression : public Expression {
-public:
-    std::unique_ptr<Expression> left;
-    std::string op;
-    std::unique_ptr<Expression> right;
-
-    BinaryExpression(std::unique_ptr<Expression> left, std::string op, std::unique_ptr<Expression> right, int line)
-        : Expression(line), left(std::move(left)), op(std::move(op)), right(std::move(right)) {}
-
-    void print() const override {
-        std::cout << "BinaryExpression(" << op << ", line: " << line << ")" << std::endl;
-        left->print();
-        right->print();
-    }
-};
-
-class UnaryExpression : public Expression {
-public:
-    std::string op;
-    std::unique_ptr<Expression> operand;
-
-    UnaryExpression(std::string op, std::unique_ptr<Expression> operand, int line)
-        : Expression(line), op(std::move(op)), operand(std::move(operand)) {}
-
-    void print() const override {
-        std::cout << "UnaryExpression(" << op << ", line: " << line << ")" << std::endl;
-        operand->print();
-    }
-};
-
-class FunctionCallExpression : public Expression {
-public:
-    std::string functionName;
-    std::vector<std::unique_ptr<Expression>> arguments;
-
-    FunctionCallExpression(std::string functionName, std::vector<std::unique_ptr<Expression>> arguments, int line)
-        : Expression(line), functionName(std::move(functionName)), arguments(std::move(arguments)) {}
-
-    void print() const override {
-        std::cout << "FunctionCallExpression(" << functionName << ", line: " << line << ")" << std::endl;
-        for (const auto& arg : arguments) {
-            arg->print();
-        }
-    }
-};
-
-class ReturnStatement : public Statement {
-public:
-    std::unique_ptr<Expression> expression;
-
-    ReturnStatement(std::unique_ptr<Expression> expression, int line) : Statement(line), expression(std::move(expression)) {}
-
-    void print() const override {
-        std::cout << "ReturnStatement, line: " << line << std::endl;
-        expression->print();
-    }
-};
-
-class ForStatement : public Statement {
-public:
-    std::unique_ptr<Statement> initializer;
-    std::unique_ptr<Expression> condition;
-    std::unique_ptr<Statement> increment;
-    std::unique_ptr<Statement> body;
-
-    ForStatement(std::unique_ptr<Statement> initializer, std::unique_ptr<Expression> condition,
-                 std::unique_ptr<Statement> increment, std::unique_ptr<Statement> body, int line)
-        : Statement(line), initializer(std::move(initializer)), condition(std::move(condition)),
-          increment(std::move(increment)), body(std::move(body)) {}
-
-    void print() const override {
-        std::cout << "ForStatement, line: " << line << std::endl;
-        if (initializer) initializer->print();
-        if (condition) condition->print();
-        if (increment) increment->print();
-        if (body) body->print();
-    }
-};
-
-class WhileStatement : public Statement {
-public:
-    std::unique_ptr<Expression> condition;
-    std::unique_ptr<Statement> body;
-
-    WhileStatement(std::unique_ptr<Expression> condition, std::unique_ptr<Statement> body, int line)
-        : Statement(line), condition(std::move(condition)), body(std::move(body)) {}
-
-    void print() const override {
-        std::cout << "WhileStatement, line: " << line << std::endl;
-        if (condition) condition->print();
-        if (body) body->print();
-    }
-};
-
-class BlockStatement : public Statement {
-public:
-    std::vector<std::unique_ptr<Statement>> statements;
-
-    BlockStatement(std::vector<std::unique_ptr<Statement>> statements, int line)
-        : Statement(line), statements(std::move(statements)) {}
-
-    void print() const override {
-        std::cout << "BlockStatement, line: " << line << std::endl;
-        for (const auto& stmt : statements) {
-            stmt->print();
-        }
-    }
-};
-
-class IncludeStatement : public Statement {
-public:
-    std::string fileName;
-
-    IncludeStatement(std::string fileName, int line) : Statement(line), fileName(std::move(fileName)) {}
-
-    void print() const override {
-        std::cout << "IncludeStatement(" << fileName << ", line: " << line << ")" << std::endl;
-    }
-};
-
-class IndexExpression : public Expression {
-public:
-    std::unique_ptr<Expression> array;
-    std::unique_ptr<Expression> index;
-
-    IndexExpression(std::unique_ptr<Expression> array, std::unique_ptr<Expression> index, int line)
-        : Expression(line), array(std::move(array)), index(std::move(index)) {}
-
-    void print() const override {
-        std::cout << "IndexExpression(";
-        array->print();
-        std::cout << ", ";
-        index->print();
-        std::cout << ", line: " << line << ")" << std::endl;
-    }
-};
-
-class FunctionDeclaration : public Statement {
-public:
-    std::string name;
-    std::vector<std::string> parameters;
-    std::vector<std::unique_ptr<Statement>> body;
-
-    FunctionDeclaration(std::string name, std::vector<std::string> parameters, std::vector<std::unique_ptr<Statement>> body, int line)
-        : Statement(line), name(std::move(name)), parameters(std::move(parameters)), body(std::move(body)) {}
-
-    void print() const override {
-        std::cout << "FunctionDeclaration(" << name << ", line: " << line << ")" << std::endl;
-        for (const auto& param : parameters) {
-            std::cout << "Param(" << param << ")" << std::endl;
-        }
-        for (const auto& stmt : body) {
-            stmt->print();
-        }
-    }
-};
-
-class IfStatement : public Statement {
-public:
-    std::unique_ptr<Expression> condition;
-    std::unique_ptr<Statement> thenBranch;
-    std::unique_ptr<Statement> elseBranch;
-
-    IfStatement(std::unique_ptr<Expression> condition, std::unique_ptr<Statement> thenBranch, std::unique_ptr<Statement> elseBranch, int line)
-        : Statement(line), condition(std::move(condition)), thenBranch(std::move(thenBranch)), elseBranch(std::move(elseBranch)) {}
-
-    void print() const override {
-        std::cout << "IfStatement, line: " << line << std::endl;
-        condition->print();
-        thenBranch->print();
-        if (elseBranch) {
-            elseBranch->print();
-        }
-    }
-};
-
-class Parser {
-public:
-    explicit Parser(Lexer &lexer) : lexer(lexer), currentToken(lexer.getNextToken()) {}
-
-    std::unique_ptr<ASTNode> parse() {
-        return parseStatement();
-    }
-
-private:
-    Lexer &lexer;
-    Token currentToken;
-
-    void advance() {
-        currentToken = lexer.getNextToken();
-    }
-
-    std::unique_ptr<ASTNode> parseStatement() {
-        if (currentToken.type == TokenType::EndOfFile) {
-            return nullptr; // Handle end of file
-        }
-
-        if (currentToken.type == TokenType::Keyword) {
-            if (currentToken.value == "write" && peekNextToken().value == "(") {
-                return parseWriteStatement();
-            } else if (currentToken.value == "func") {
-                return parseFunctionDeclaration();
-            } else if (currentToken.value == "if") {
-                return parseIfStatement();
-            } else if (currentToken.value == "return") {
-                return parseReturnStatement();
-            } else if (currentToken.value == "for") {
-                return parseForStatement();
-            } else if (currentToken.value == "while") {
-                return parseWhileStatement();
-            } else if (currentToken.value == "include" && peekNextToken().type == TokenType::StringLiteral) {
-                return parseIncludeStatement();
-            } else if (currentToken.value == "let" || currentToken.value == "const") {
-                return parseLetDeclaration();
-            } else {
-                throw std::runtime_error("Unexpected keyword: " + currentToken.value + " at line " + std::to_string(currentToken.line));
-            }
-        } else if (currentToken.type == TokenType::Identifier) {
-            return parseExpressionStatement();
-        } else {
-            throw std::runtime_error("Unexpected token: " + currentToken.value + " at line " + std::to_string(currentToken.line));
-        }
-    }
-
-    std::unique_ptr<Statement> castToStatement(std::unique_ptr<ASTNode> node) {
-        return std::unique_ptr<Statement>(dynamic_cast<Statement*>(node.release()));
-    }
-
-    std::unique_ptr<ASTNode> parseWriteStatement() {
-        int line = currentToken.line;
-        advance(); // consume 'write'
-        if (currentToken.value != "(") {
-            throw std::runtime_error("Expected '(' after 'write' at line " + std::to_string(line));
-        }
-        advance(); // consume '('
-
-        auto messageExpr = parseExpression();
-
-        if (currentToken.value != ")") {
-            throw std::runtime_error("Expected ')' after message or variable at line " + std::to_string(line));
-        }
-        advance(); // consume ')'
-
-        if (currentToken.value == ";") {
-            advance(); // consume optional ';'
-        } else if (currentToken.value != "}" && currentToken.type != TokenType::EndOfFile) {
-            throw std::runtime_error("Expected ';' after 'write' statement at line " + std::to_string(line));
-        }
-
-        return std::make_unique<WriteStatement>(std::move(messageExpr), line);
-    }
-
-    std::unique_ptr<ASTNode> parseVariableDeclaration() {
-        int line = currentToken.line;
-        std::string type = currentToken.value;
-        advance(); // consume type
-
-        if (currentToken.type != TokenType::Identifier) {
-            throw std::runtime_error("Expected variable name in declaration at line " + std::to_string(line));
-        }
-        std::string name = currentToken.value;
-        advance(); // consume variable name
-
-        lexer.registerIdentifier(name); // Register the identifier in the lexer
-
-        std::unique_ptr<Expression> initializer;
-        if (currentToken.value == "=") {
-            advance(); // consume '='
-            initializer = parseExpression();
-        }
-
-        if (currentToken.value == ";") {
-            advance(); // consume optional ';'
-        } else if (currentToken.value != "}" && currentToken.type != TokenType::EndOfFile) {
-            throw std::runtime_error("Expected ';' after variable declaration at line " + std::to_string(line));
-        }
-
-        return std::make_unique<VariableDeclaration>(type, name, std::move(initializer), line);
-    }
-
-    std::unique_ptr<ASTNode> parseLetDeclaration() {
-        int line = currentToken.line;
-        std::string type = currentToken.value; // 'let' or 'const'
-        advance(); // consume 'let' or 'const'
-
-        if (currentToken.type != TokenType::Identifier) {
-            throw std::runtime_error("Expected variable name in let/const declaration at line " + std::to_string(line));
-        }
-        std::string name = currentToken.value;
-        advance(); // consume variable name
-
-        lexer.registerIdentifier(name); // Register the identifier in the lexer
-
-        std::unique_ptr<Expression> initializer;
-        if (currentToken.value == "=") {
-            advance(); // consume '='
-            initializer = parseExpression();
-        }
-
-        if (currentToken.value == ";") {
-            advance(); // consume optional ';'
-        } else if (currentToken.value != "}" && currentToken.type != TokenType::EndOfFile) {
-            throw std::runtime_error("Expected ';' after let/const declaration at line " + std::to_string(line));
-        }
-
-        return std::make_unique<VariableDeclaration>(type, name, std::move(initializer), line);
-    }
-
-    std::unique_ptr<Expression> parseExpression() {
-        auto left = parsePrimary();
-
-        while (currentToken.type == TokenType::Operator) {
-            std::string op = currentToken.value;
-            if (op == "++" || op == "--") {
-                advance(); // consume operator
-                return std::make_unique<UnaryExpression>(op, std::move(left), currentToken.line);
-            }
-            advance(); // consume operator
-            auto right = parsePrimary();
-            left = std::make_unique<BinaryExpression>(std::move(left), op, std::move(right), currentToken.line);
-        }
-
-        return left;
-    }
-
-    std::unique_ptr<Expression> parsePrimary() {
-        int line = currentToken.line;
-
-        if (currentToken.type == TokenType::Number) {
-            double value = std::stod(currentToken.value);
-            advance(); // consume number
-            return std::make_unique<NumberExpression>(value, line);
-        }
-
-        if (currentToken.type == TokenType::Identifier) {
-            std::string name = currentToken.value;
-            advance(); // consume identifier
-
-            if (currentToken.type == TokenType::Symbol && currentToken.value == "[") {
-                advance(); // consume '['
-                auto indexExpr = parseExpression();
-                if (currentToken.value != "]") {
-                    throw std::runtime_error("Expected ']' after index at line " + std::to_string(currentToken.line));
-                }
-                advance(); // consume ']'
-                return std::make_unique<IndexExpression>(std::make_unique<VariableExpression>(name, line), std::move(indexExpr), line);
-            }
-
-            if (currentToken.type == TokenType::Symbol && currentToken.value == "(") {
-                advance(); // consume '('
-                std::vector<std::unique_ptr<Expression>> arguments;
-                while (currentToken.type != TokenType::Symbol || currentToken.value != ")") {
-                    arguments.push_back(parseExpression());
-                    if (currentToken.type == TokenType::Symbol && currentToken.value == ",") {
-                        advance(); // consume ','
-                    } else if (currentToken.type == TokenType::Symbol && currentToken.value == ")") {
-                        break;
-                    } else {
-                        throw std::runtime_error("Expected ',' or ')' in function call at line " + std::to_string(currentToken.line));
-                    }
-                }
-                advance(); // consume ')'
-                return std::make_unique<FunctionCallExpression>(name, std::move(arguments), line);
-            }
-
-            return std::make_unique<VariableExpression>(name, line);
-        }
-
-        if (currentToken.type == TokenType::StringLiteral) {
-            std::string value = currentToken.value;
-            advance(); // consume string literal
-            return std::make_unique<StringExpression>(value, line);
-        }
-
-        if (currentToken.type == TokenType::Keyword && (currentToken.value == "true" || currentToken.value == "false")) {
-            bool value = (currentToken.value == "true");
-            advance(); // consume 'true' or 'false'
-            return std::make_unique<BoolExpression>(value, line);
-        }
-
-        if (currentToken.type == TokenType::Symbol && currentToken.value == "[") {
-            // Array or list parsing
-            advance(); // consume '['
-            std::vector<std::unique_ptr<Expression>> elements;
-            while (currentToken.type != TokenType::Symbol || currentToken.value != "]") {
-                elements.push_back(parseExpression());
-                if (currentToken.type == TokenType::Symbol && currentToken.value == ",") {
-                    advance(); // consume ','
-                } else if (currentToken.type == TokenType::Symbol && currentToken.value == "]") {
-                    break;
-                } else {
-                    throw std::runtime_error("Expected ',' or ']' in array or list at line " + std::to_string(currentToken.line));
-                }
-            }
-            advance(); // consume ']'
-            return std::make_unique<ArrayExpression>(std::move(elements), line);
-        }
-
-        if (currentToken.type == TokenType::Keyword && currentToken.value == "read") {
-            advance(); // consume 'read'
-            if (currentToken.value != "(") {
-                throw std::runtime_error("Expected '(' after 'read' at line " + std::to_string(currentToken.line));
-            }
-            advance(); // consume '('
-            std::unique_ptr<Expression> prompt = nullptr;
-            if (currentToken.type != TokenType::Symbol || currentToken.value != ")") {
-                prompt = parseExpression();
-            }
-            if (currentToken.value != ")") {
-                throw std::runtime_error("Expected ')' after 'read' argument at line " + std::to_string(currentToken.line));
-            }
-            advance(); // consume ')'
-            return std::make_unique<ReadExpression>(std::move(prompt), line);
-        }
-
-        throw std::runtime_error("Expected primary expression at line " + std::to_string(currentToken.line));
-    }
-
-    std::unique_ptr<ASTNode> parseFunctionDeclaration() {
-        int line = currentToken.line;
-        advance(); // consume 'func'
-
-        if (currentToken.type != TokenType::Identifier) {
-            throw std::runtime_error("Expected function name in declaration at line " + std::to_string(line));
-        }
-        std::string name = currentToken.value;
-        advance(); // consume function name
-
-        if (currentToken.value != "(") {
-            throw std::runtime_error("Expected '(' after function name at line " + std::to_string(line));
-        }
-        advance(); // consume '('
-
-        std::vector<std::string> parameters;
-        while (currentToken.value != ")") {
-            if (currentToken.type != TokenType::Identifier) {
-                throw std::runtime_error("Expected parameter name at line " + std::to_string(line));
-            }
-            parameters.push_back(currentToken.value);
-            advance(); // consume parameter
-
-            if (currentToken.value == ",") {
-                advance(); // consume ','
-            } else if (currentToken.value != ")") {
-                throw std::runtime_error("Expected ',' or ')' after parameter at line " + std::to_string(line));
-            }
-        }
-        advance(); // consume ')'
-
-        if (currentToken.value != "{") {
-            throw std::runtime_error("Expected '{' before function body at line " + std::to_string(line));
-        }
-        advance(); // consume '{'
-
-        std::vector<std::unique_ptr<Statement>> body;
-        while (currentToken.value != "}") {
-            body.push_back(castToStatement(parseStatement()));
-        }
-        advance(); // consume '}'
-
-        return std::make_unique<FunctionDeclaration>(name, std::move(parameters), std::move(body), line);
-    }
-
-    std::unique_ptr<ASTNode> parseIfStatement() {
-        int line = currentToken.line;
-        advance(); // consume 'if'
-
-        if (currentToken.value != "(") {
-            throw std::runtime_error("Expected '(' after 'if' at line " + std::to_string(line));
-        }
-        advance(); // consume '('
-
-        auto condition = parseExpression();
-
-        if (currentToken.value != ")") {
-            throw std::runtime_error("Expected ')' after condition at line " + std::to_string(line));
-        }
-        advance(); // consume ')'
-
-        auto thenBranch = castToStatement(parseBlock());
-        std::unique_ptr<Statement> elseBranch = nullptr;
-
-        if (currentToken.value == "else") {
-            advance(); // consume 'else'
-            elseBranch = castToStatement(parseBlock());
-        }
-
-        return std::make_unique<IfStatement>(std::move(condition), std::move(thenBranch), std::move(elseBranch), line);
-    }
-
-    std::unique_ptr<Statement> parseReturnStatement() {
-        int line = currentToken.line;
-        advance(); // consume 'return'
-
-        auto expression = parseExpression();
-
-        if (currentToken.value == ";") {
-            advance(); // consume optional ';'
-        } else if (currentToken.value != "}" && currentToken.type != TokenType::EndOfFile) {
-            throw std::runtime_error("Expected ';' after 'return' statement at line " + std::to_string(line));
-        }
-
-        return std::make_unique<ReturnStatement>(std::move(expression), line);
-    }
-
-    std::unique_ptr<Statement> parseForStatement() {
-        int line = currentToken.line;
-        advance(); // consume 'for'
-
-        if (currentToken.value != "(") {
-            throw std::runtime_error("Expected '(' after 'for' at line " + std::to_string(line));
-        }
-        advance(); // consume '('
-
-        auto initializer = castToStatement(parseStatement());
-
-        if (currentToken.value != ";") {
-            throw std::runtime_error("Expected ';' after initializer in 'for' statement at line " + std::to_string(line));
-        }
-        advance(); // consume ';'
-
-        auto condition = parseExpression();
-
-        if (currentToken.value != ";") {
-            throw std::runtime_error("Expected ';' after condition in 'for' statement at line " + std::to_string(line));
-        }
-        advance(); // consume ';'
-
-        auto increment = castToStatement(parseExpressionStatement());
-
-        if (currentToken.value != ")") {
-            throw std::runtime_error("Expected ')' after increment in 'for' statement at line " + std::to_string(line));
-        }
-        advance(); // consume ')'
-
-        auto body = castToStatement(parseBlock());
-
-        return std::make_unique<ForStatement>(std::move(initializer), std::move(condition), std::move(increment), std::move(body), line);
-    }
-
-    std::unique_ptr<Statement> parseWhileStatement() {
-        int line = currentToken.line;
-        advance(); // consume 'while'
-
-        if (currentToken.value != "(") {
-            throw std::runtime_error("Expected '(' after 'while' at line " + std::to_string(line));
-        }
-        advance(); // consume '('
-
-        auto condition = parseExpression();
-
-        if (currentToken.value != ")") {
-            throw std::runtime_error("Expected ')' after condition at line " + std::to_string(line));
-        }
-        advance(); // consume ')'
-
-        auto body = castToStatement(parseBlock());
-
-        return std::make_unique<WhileStatement>(std::move(condition), std::move(body), line);
-    }
-
-    std::unique_ptr<Statement> parseIncludeStatement() {
-        int line = currentToken.line;
-        advance(); // consume 'include'
-
-        if (currentToken.type != TokenType::StringLiteral) {
-            throw std::runtime_error("Expected string literal after 'include' at line " + std::to_string(line));
-        }
-
-        std::string fileName = currentToken.value;
-        advance(); // consume string literal
-
-        if (currentToken.value == ";") {
-            advance(); // consume optional ';'
-        } else if (currentToken.value != "}" && currentToken.type != TokenType::EndOfFile) {
-            throw std::runtime_error("Expected ';' after 'include' statement at line " + std::to_string(line));
-        }
-
-        return std::make_unique<IncludeStatement>(fileName, line);
-    }
-
-    std::unique_ptr<ASTNode> parseBlock() {
-        if (currentToken.value != "{") {
-            return parseStatement();
-        }
-
-        int line = currentToken.line;
-        advance(); // consume '{'
-
-        std::vector<std::unique_ptr<Statement>> statements;
-        while (currentToken.value != "}") {
-            statements.push_back(castToStatement(parseStatement()));
-        }
-        advance(); // consume '}'
-
-        return std::make_unique<BlockStatement>(std::move(statements), line);
-    }
-
-    std::unique_ptr<ASTNode> parseExpressionStatement() {
-        auto expr = parseExpression();
-
-        if (currentToken.type == TokenType::EndOfFile || currentToken.value == ";") {
-            if (currentToken.type != TokenType::EndOfFile) {
-                advance(); // consume ';'
-            }
-            return expr;
-        } else {
-            throw std::runtime_error("Expected ';' after expression statement at line " + std::to_string(currentToken.line));
-        }
-    }
-
-    Token peekNextToken() {
-        size_t savedPosition = lexer.position;
-        int savedLine = lexer.line;
-        Token nextToken = lexer.getNextToken();
-        lexer.position = savedPosition;
-        lexer.line = savedLine;
-        return nextToken;
-    }
-};
+#include <array>
+#include <cstdint>
+#include <vector>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <utility>
+
+enum class NodeKind : uint8_t {
+    WriteStatement,
+    VariableDeclaration,
+    ExpressionStatement,
+    ReturnStatement,
+    ForStatement,
+    WhileStatement,
+    BlockStatement,
+    IncludeStatement,
+    FunctionDeclaration,
+    IfStatement,
+    NumberExpression,
+    StringExpression,
+    BoolExpression,
+    ArrayExpression,
+    VariableExpression,
+    BinaryExpression,
+    UnaryExpression,
+    FunctionCallExpression,
+    ReadExpression,
+    IndexExpression
+};
+
+// Nodes live in the Arena of the parse that created them and point at each other with plain
+// pointers. `kind` names the concrete class, so the passes over the tree switch on it and
+// downcast with nodeCast instead of going through virtual calls and dynamic_cast.
+class ASTNode {
+public:
+    NodeKind kind;
+    int line;
+    ASTNode(NodeKind kind, int line) : kind(kind), line(line) {}
+
+    void print() const;
+};
+
+class Expression : public ASTNode {
+public:
+    using ASTNode::ASTNode;
+};
+
+class Statement : public ASTNode {
+public:
+    using ASTNode::ASTNode;
+};
+
+class WriteStatement : public Statement {
+public:
+    static constexpr NodeKind KIND = NodeKind::WriteStatement;
+
+    Expression* messageExpr;
+
+    explicit WriteStatement(Expression* messageExpr, int line)
+        : Statement(KIND, line), messageExpr(messageExpr) {}
+
+    void print() const {
+        std::cout << "WriteStatement(";
+        messageExpr->print();
+        std::cout << ", line: " << line << ")" << std::endl;
+    }
+};
+
+class ReadExpression : public Expression {
+public:
+    static constexpr NodeKind KIND = NodeKind::ReadExpression;
+
+    Expression* prompt;
+
+    ReadExpression(Expression* prompt, int line)
+        : Expression(KIND, line), prompt(prompt) {}
+
+    void print() const {
+        std::cout << "ReadExpression(";
+        if (prompt) {
+            prompt->print();
+        }
+        std::cout << ", line: " << line << ")" << std::endl;
+    }
+};
+
+class VariableDeclaration : public Statement {
+public:
+    static constexpr NodeKind KIND = NodeKind::VariableDeclaration;
+
+    bool isConstant;
+    SymbolId name;
+    Expression* initializer;
+
+    VariableDeclaration(bool isConstant, SymbolId name, Expression* initializer, int line)
+        : Statement(KIND, line), isConstant(isConstant), name(name), initializer(initializer) {}
+
+    void print() const {
+        std::cout << "VariableDeclaration(" << (isConstant ? "const" : "let") << " " << Symbols::name(name) << ", line: " << line << ")" << std::endl;
+        if (initializer) {
+            initializer->print();
+        }
+    }
+};
+
+class NumberExpression : public Expression {
+public:
+    static constexpr NodeKind KIND = NodeKind::NumberExpression;
+
+    // A literal with a fraction is a double and has its value in `real`; any other in `integer`.
+    bool isDouble;
+    int64_t integer;
+    double real;
+
+    NumberExpression(int64_t value, int line) : Expression(KIND, line), isDouble(false), integer(value), real(0) {}
+    NumberExpression(double value, int line) : Expression(KIND, line), isDouble(true), integer(0), real(value) {}
+
+    void print() const {
+        std::cout << "NumberExpression(";
+        if (isDouble) {
+            std::cout << real;
+        } else {
+            std::cout << integer;
+        }
+        std::cout << ", line: " << line << ")" << std::endl;
+    }
+};
+
+class StringExpression : public Expression {
+public:
+    static constexpr NodeKind KIND = NodeKind::StringExpression;
+
+    SymbolId value;
+
+    StringExpression(SymbolId value, int line) : Expression(KIND, line), value(value) {}
+
+    void print() const {
+        std::cout << "StringExpression(" << Symbols::name(value) << ", line: " << line << ")" << std::endl;
+    }
+};
+
+class BoolExpression : public Expression {
+public:
+    static constexpr NodeKind KIND = NodeKind::BoolExpression;
+
+    bool value;
+
+    BoolExpression(bool value, int line) : Expression(KIND, line), value(value) {}
+
+    void print() const {
+        std::cout << "BoolExpression(" << value << ", line: " << line << ")" << std::endl;
+    }
+};
+
+class ArrayExpression : public Expression {
+public:
+    static constexpr NodeKind KIND = NodeKind::ArrayExpression;
+
+    NodeList<Expression> elements;
+
+    ArrayExpression(NodeList<Expression> elements, int line)
+        : Expression(KIND, line), elements(elements) {}
+
+    void print() const {
+        std::cout << "ArrayExpression, line: " << line << std::endl;
+        for (const auto& elem : elements) {
+            elem->print();
+        }
+    }
+};
+
+class VariableExpression : public Expression {
+public:
+    static constexpr NodeKind KIND = NodeKind::VariableExpression;
+
+    SymbolId name;
+
+    VariableExpression(SymbolId name, int line) : Expression(KIND, line), name(name) {}
+
+    void print() const {
+        std::cout << "VariableExpression(" << Symbols::name(name) << ", line: " << line << ")" << std::endl;
+    }
+};
+
+class BinaryExpression : public Expression {
+public:
+    static constexpr NodeKind KIND = NodeKind::BinaryExpression;
+
+    Expression* left;
+    Op op;
+    Expression* right;
+
+    BinaryExpression(Expression* left, Op op, Expression* right, int line)
+        : Expression(KIND, line), left(left), op(op), right(right) {}
+
+    void print() const {
+        std::cout << "BinaryExpression(" << opName(op) << ", line: " << line << ")" << std::endl;
+        left->print();
+        right->print();
+    }
+};
+
+class UnaryExpression : public Expression {
+public:
+    static constexpr NodeKind KIND = NodeKind::UnaryExpression;
+
+    Op op;
+    Expression* operand;
+    bool isPrefix; // ++x rather than x++
+
+    UnaryExpression(Op op, Expression* operand, int line, bool isPrefix = false)
+        : Expression(KIND, line), op(op), operand(operand), isPrefix(isPrefix) {}
+
+    void print() const {
+        std::cout << "UnaryExpression(" << opName(op) << (isPrefix ? ", prefix" : "") << ", line: " << line << ")" << std::endl;
+        operand->print();
+    }
+};
+
+class FunctionCallExpression : public Expression {
+public:
+    static constexpr NodeKind KIND = NodeKind::FunctionCallExpression;
+
+    SymbolId functionName;
+    NodeList<Expression> arguments;
+
+    FunctionCallExpression(SymbolId functionName, NodeList<Expression> arguments, int line)
+        : Expression(KIND, line), functionName(functionName), arguments(arguments) {}
+
+    void print() const {
+        std::cout << "FunctionCallExpression(" << Symbols::name(functionName) << ", line: " << line << ")" << std::endl;
+        for (const auto& arg : arguments) {
+            arg->print();
+        }
+    }
+};
+
+class ExpressionStatement : public Statement {
+public:
+    static constexpr NodeKind KIND = NodeKind::ExpressionStatement;
+
+    Expression* expression;
+
+    ExpressionStatement(Expression* expression, int line)
+        : Statement(KIND, line), expression(expression) {}
+
+    void print() const {
+        std::cout << "ExpressionStatement, line: " << line << std::endl;
+        expression->print();
+    }
+};
+
+class ReturnStatement : public Statement {
+public:
+    static constexpr NodeKind KIND = NodeKind::ReturnStatement;
+
+    Expression* expression;
+
+    ReturnStatement(Expression* expression, int line) : Statement(KIND, line), expression(expression) {}
+
+    void print() const {
+        std::cout << "ReturnStatement, line: " << line << std::endl;
+        expression->print();
+    }
+};
+
+class ForStatement : public Statement {
+public:
+    static constexpr NodeKind KIND = NodeKind::ForStatement;
+
+    Statement* initializer;
+    Expression* condition;
+    Statement* increment;
+    Statement* body;
+
+    ForStatement(Statement* initializer, Expression* condition,
+                 Statement* increment, Statement* body, int line)
+        : Statement(KIND, line), initializer(initializer), condition(condition),
+          increment(increment), body(body) {}
+
+    void print() const {
+        std::cout << "ForStatement, line: " << line << std::endl;
+        if (initializer) initializer->print();
+        if (condition) condition->print();
+        if (increment) increment->print();
+        if (body) body->print();
+    }
+};
+
+class WhileStatement : public Statement {
+public:
+    static constexpr NodeKind KIND = NodeKind::WhileStatement;
+
+    Expression* condition;
+    Statement* body;
+
+    WhileStatement(Expression* condition, Statement* body, int line)
+        : Statement(KIND, line), condition(condition), body(body) {}
+
+    void print() const {
+        std::cout << "WhileStatement, line: " << line << std::endl;
+        if (condition) condition->print();
+        if (body) body->print();
+    }
+};
+
+class BlockStatement : public Statement {
+public:
+    static constexpr NodeKind KIND = NodeKind::BlockStatement;
+
+    NodeList<Statement> statements;
+
+    BlockStatement(NodeList<Statement> statements, int line)
+        : Statement(KIND, line), statements(statements) {}
+
+    void print() const {
+        std::cout << "BlockStatement, line: " << line << std::endl;
+        for (const auto& stmt : statements) {
+            stmt->print();
+        }
+    }
+};
+
+class IncludeStatement : public Statement {
+public:
+    static constexpr NodeKind KIND = NodeKind::IncludeStatement;
+
+    SymbolId fileName;
+
+    IncludeStatement(SymbolId fileName, int line) : Statement(KIND, line), fileName(fileName) {}
+
+    void print() const {
+        std::cout << "IncludeStatement(" << Symbols::name(fileName) << ", line: " << line << ")" << std::endl;
+    }
+};
+
+class IndexExpression : public Expression {
+public:
+    static constexpr NodeKind KIND = NodeKind::IndexExpression;
+
+    Expression* array;
+    Expression* index;
+
+    IndexExpression(Expression* array, Expression* index, int line)
+        : Expression(KIND, line), array(array), index(index) {}
+
+    void print() const {
+        std::cout << "IndexExpression(";
+        array->print();
+        std::cout << ", ";
+        index->print();
+        std::cout << ", line: " << line << ")" << std::endl;
+    }
+};
+
+class FunctionDeclaration : public Statement {
+public:
+    static constexpr NodeKind KIND = NodeKind::FunctionDeclaration;
+
+    SymbolId name;
+    std::vector<SymbolId> parameters;
+    NodeList<Statement> body;
+
+    // A body the parser skipped in lazy mode, left empty: it is the text at `lazyOffset` in
+    // `lazySource`, right after the '{', on line `lazyLine`. See Parser::parseLazyBody.
+    std::string_view lazySource;
+    size_t lazyOffset = 0;
+    int lazyLine = 0;
+
+    FunctionDeclaration(SymbolId name, std::vector<SymbolId> parameters, NodeList<Statement> body, int line)
+        : Statement(KIND, line), name(name), parameters(std::move(parameters)), body(body) {}
+
+    FunctionDeclaration(SymbolId name, std::vector<SymbolId> parameters, std::string_view source, size_t bodyOffset, int bodyLine, int line)
+        : Statement(KIND, line), name(name), parameters(std::move(parameters)),
+          lazySource(source), lazyOffset(bodyOffset), lazyLine(bodyLine) {}
+
+    bool isLazy() const {
+        return lazySource.data() != nullptr;
+    }
+
+    void print() const {
+        std::cout << "FunctionDeclaration(" << Symbols::name(name) << ", line: " << line << ")" << std::endl;
+        for (SymbolId param : parameters) {
+            std::cout << "Param(" << Symbols::name(param) << ")" << std::endl;
+        }
+        if (isLazy()) {
+            std::cout << "LazyBody(line: " << lazyLine << ")" << std::endl;
+        }
+        for (const auto& stmt : body) {
+            stmt->print();
+        }
+    }
+};
+
+class IfStatement : public Statement {
+public:
+    static constexpr NodeKind KIND = NodeKind::IfStatement;
+
+    Expression* condition;
+    Statement* thenBranch;
+    Statement* elseBranch;
+
+    IfStatement(Expression* condition, Statement* thenBranch, Statement* elseBranch, int line)
+        : Statement(KIND, line), condition(condition), thenBranch(thenBranch), elseBranch(elseBranch) {}
+
+    void print() const {
+        std::cout << "IfStatement, line: " << line << std::endl;
+        condition->print();
+        thenBranch->print();
+        if (elseBranch) {
+            elseBranch->print();
+        }
+    }
+};
+
+template <typename T, typename Node>
+T* nodeCast(Node* node) {
+    return node && node->kind == T::KIND ? static_cast<T*>(node) : nullptr;
+}
+
+inline void ASTNode::print() const {
+    switch (kind) {
+        case NodeKind::WriteStatement: static_cast<const WriteStatement*>(this)->print(); break;
+        case NodeKind::VariableDeclaration: static_cast<const VariableDeclaration*>(this)->print(); break;
+        case NodeKind::ExpressionStatement: static_cast<const ExpressionStatement*>(this)->print(); break;
+        case NodeKind::ReturnStatement: static_cast<const ReturnStatement*>(this)->print(); break;
+        case NodeKind::ForStatement: static_cast<const ForStatement*>(this)->print(); break;
+        case NodeKind::WhileStatement: static_cast<const WhileStatement*>(this)->print(); break;
+        case NodeKind::BlockStatement: static_cast<const BlockStatement*>(this)->print(); break;
+        case NodeKind::IncludeStatement: static_cast<const IncludeStatement*>(this)->print(); break;
+        case NodeKind::FunctionDeclaration: static_cast<const FunctionDeclaration*>(this)->print(); break;
+        case NodeKind::IfStatement: static_cast<const IfStatement*>(this)->print(); break;
+        case NodeKind::NumberExpression: static_cast<const NumberExpression*>(this)->print(); break;
+        case NodeKind::StringExpression: static_cast<const StringExpression*>(this)->print(); break;
+        case NodeKind::BoolExpression: static_cast<const BoolExpression*>(this)->print(); break;
+        case NodeKind::ArrayExpression: static_cast<const ArrayExpression*>(this)->print(); break;
+        case NodeKind::VariableExpression: static_cast<const VariableExpression*>(this)->print(); break;
+        case NodeKind::BinaryExpression: static_cast<const BinaryExpression*>(this)->print(); break;
+        case NodeKind::UnaryExpression: static_cast<const UnaryExpression*>(this)->print(); break;
+        case NodeKind::FunctionCallExpression: static_cast<const FunctionCallExpression*>(this)->print(); break;
+        case NodeKind::ReadExpression: static_cast<const ReadExpression*>(this)->print(); break;
+        case NodeKind::IndexExpression: static_cast<const IndexExpression*>(this)->print(); break;
+    }
+}
+
+class Parser {
+public:
+    // Nodes are allocated in `arena`, which must outlive every statement parse() returns. With
+    // `lazyFunctions`, function bodies are only brace-matched and are parsed by parseLazyBody
+    // when the function is first called; a syntax error in a body then surfaces at that call.
+    Parser(Lexer &lexer, Arena &arena, bool lazyFunctions = false)
+        : lexer(lexer), arena(arena), lazyFunctions(lazyFunctions), currentToken(lexer.getNextToken()) {}
+
+    // Returns the next top-level statement, or nullptr at the end of the input.
+    Statement* parse() {
+        return parseStatement();
+    }
+
+    // The offset and line of the token parse() starts at, past the previous statement.
+    size_t offset() const {
+        return currentToken.offset;
+    }
+
+    int line() const {
+        return currentToken.line;
+    }
+
+    // Parses the statements of a body skipped in lazy mode, which starts at `offset` in `source`
+    // on line `line`, up to its closing '}'. Functions declared inside it are lazy again.
+    static std::vector<Statement*> parseLazyBody(std::string_view source, size_t offset, int line, Arena &arena) {
+        Lexer lexer(source, offset, line);
+        Parser parser(lexer, arena, true);
+        std::vector<Statement*> body;
+        while (parser.currentToken.sym != Sym::RightBrace) {
+            body.push_back(parser.parseRequiredStatement());
+        }
+        return body;
+    }
+
+private:
+    // Tokens already lexed past currentToken, oldest first, in a ring of LOOKAHEAD slots.
+    // Every token is lexed exactly once: peekToken fills the ring and advance drains it
+    // before asking the lexer for more.
+    static constexpr size_t LOOKAHEAD = 4;
+
+    Lexer &lexer;
+    Arena &arena;
+    bool lazyFunctions;
+    Token currentToken;
+    std::array<Token, LOOKAHEAD> lookahead;
+    size_t lookaheadStart = 0;
+    size_t lookaheadCount = 0;
+
+    void advance() {
+        if (lookaheadCount > 0) {
+            currentToken = lookahead[lookaheadStart];
+            lookaheadStart = (lookaheadStart + 1) % LOOKAHEAD;
+            --lookaheadCount;
+        } else {
+            currentToken = lexer.getNextToken();
+        }
+    }
+
+    // The token `distance` places after currentToken, so peekToken() is the next one.
+    const Token& peekToken(size_t distance = 1) {
+        if (distance == 0 || distance > LOOKAHEAD) {
+            throw std::logic_error("Parser lookahead of " + std::to_string(distance) + " tokens is not supported");
+        }
+        while (lookaheadCount < distance) {
+            lookahead[(lookaheadStart + lookaheadCount) % LOOKAHEAD] = lexer.getNextToken();
+            ++lookaheadCount;
+        }
+        return lookahead[(lookaheadStart + distance - 1) % LOOKAHEAD];
+    }
+
+    Statement* parseStatement() {
+        if (currentToken.type == TokenType::EndOfFile) {
+            return nullptr; // Handle end of file
+        }
+
+        if (currentToken.type == TokenType::Keyword) {
+            if (currentToken.keyword == Keyword::Write && peekToken().sym == Sym::LeftParen) {
+                return parseWriteStatement();
+            } else if (currentToken.keyword == Keyword::Func) {
+                return parseFunctionDeclaration();
+            } else if (currentToken.keyword == Keyword::If) {
+                return parseIfStatement();
+            } else if (currentToken.keyword == Keyword::Return) {
+                return parseReturnStatement();
+            } else if (currentToken.keyword == Keyword::For) {
+                return parseForStatement();
+            } else if (currentToken.keyword == Keyword::While) {
+                return parseWhileStatement();
+            } else if (currentToken.keyword == Keyword::Include && peekToken().type == TokenType::StringLiteral) {
+                return parseIncludeStatement();
+            } else if (currentToken.keyword == Keyword::Let || currentToken.keyword == Keyword::Const) {
+                return parseLetDeclaration();
+            } else {
+                throw std::runtime_error("Unexpected keyword: " + std::string(currentToken.value) + " at line " + std::to_string(currentToken.line));
+            }
+        } else if (currentToken.type == TokenType::Identifier || currentToken.op == Op::Increment || currentToken.op == Op::Decrement) {
+            return parseExpressionStatement();
+        } else {
+            throw std::runtime_error("Unexpected token: " + std::string(currentToken.value) + " at line " + std::to_string(currentToken.line));
+        }
+    }
+
+    // A statement that must be there, such as a loop body or an element of a block.
+    Statement* parseRequiredStatement() {
+        if (currentToken.type == TokenType::EndOfFile) {
+            throw std::runtime_error("Unexpected end of file at line " + std::to_string(currentToken.line));
+        }
+        return parseStatement();
+    }
+
+    Statement* parseWriteStatement() {
+        int line = currentToken.line;
+        advance(); // consume 'write'
+        if (currentToken.sym != Sym::LeftParen) {
+            throw std::runtime_error("Expected '(' after 'write' at line " + std::to_string(line));
+        }
+        advance(); // consume '('
+
+        auto messageExpr = parseExpression();
+
+        if (currentToken.sym != Sym::RightParen) {
+            throw std::runtime_error("Expected ')' after message or variable at line " + std::to_string(line));
+        }
+        advance(); // consume ')'
+
+        if (currentToken.sym == Sym::Semicolon) {
+            advance(); // consume optional ';'
+        } else if (currentToken.sym != Sym::RightBrace && currentToken.type != TokenType::EndOfFile) {
+            throw std::runtime_error("Expected ';' after 'write' statement at line " + std::to_string(line));
+        }
+
+        return arena.make<WriteStatement>(messageExpr, line);
+    }
+
+    Statement* parseVariableDeclaration() {
+        int line = currentToken.line;
+        bool isConstant = currentToken.keyword == Keyword::Const;
+        advance(); // consume type
+
+        if (currentToken.type != TokenType::Identifier) {
+            throw std::runtime_error("Expected variable name in declaration at line " + std::to_string(line));
+        }
+        SymbolId name = currentToken.symbol;
+        advance(); // consume variable name
+
+        Expression* initializer = nullptr;
+        if (currentToken.op == Op::Assign) {
+            advance(); // consume '='
+            initializer = parseExpression();
+        }
+
+        if (currentToken.sym == Sym::Semicolon) {
+            advance(); // consume optional ';'
+        } else if (currentToken.sym != Sym::RightBrace && currentToken.type != TokenType::EndOfFile) {
+            throw std::runtime_error("Expected ';' after variable declaration at line " + std::to_string(line));
+        }
+
+        return arena.make<VariableDeclaration>(isConstant, name, initializer, line);
+    }
+
+    Statement* parseLetDeclaration() {
+        int line = currentToken.line;
+        bool isConstant = currentToken.keyword == Keyword::Const;
+        advance(); // consume 'let' or 'const'
+
+        if (currentToken.type != TokenType::Identifier) {
+            throw std::runtime_error("Expected variable name in let/const declaration at line " + std::to_string(line));
+        }
+        SymbolId name = currentToken.symbol;
+        advance(); // consume variable name
+
+        Expression* initializer = nullptr;
+        if (currentToken.op == Op::Assign) {
+            advance(); // consume '='
+            initializer = parseExpression();
+        }
+
+        if (currentToken.sym == Sym::Semicolon) {
+            advance(); // consume optional ';'
+        } else if (currentToken.sym != Sym::RightBrace && currentToken.type != TokenType::EndOfFile) {
+            throw std::runtime_error("Expected ';' after let/const declaration at line " + std::to_string(line));
+        }
+
+        return arena.make<VariableDeclaration>(isConstant, name, initializer, line);
+    }
+
+    // Binding power of each binary operator, from assignment (loosest) to '**' (tightest);
+    // 0 for operators that cannot appear between two operands.
+    static int precedence(Op op) {
+        switch (op) {
+            case Op::Assign: return 1;
+            case Op::Equal: case Op::NotEqual: return 2;
+            case Op::Less: case Op::Greater: case Op::LessEqual: case Op::GreaterEqual: return 3;
+            case Op::Add: case Op::Subtract: return 4;
+            case Op::Multiply: case Op::Divide: return 5;
+            case Op::Power: return 6;
+            default: return 0;
+        }
+    }
+
+    // Precedence climbing: parses operators that bind at least as tightly as minPrecedence.
+    // '=' and '**' are right-associative, all other binary operators associate to the left.
+    Expression* parseExpression(int minPrecedence = 1) {
+        auto left = parseUnary();
+
+        while (currentToken.type == TokenType::Operator) {
+            Op op = currentToken.op;
+            int opPrecedence = precedence(op);
+            if (opPrecedence == 0 || opPrecedence < minPrecedence) {
+                break;
+            }
+            int line = currentToken.line;
+            advance(); // consume operator
+            bool rightAssociative = op == Op::Assign || op == Op::Power;
+            auto right = parseExpression(rightAssociative ? opPrecedence : opPrecedence + 1);
+            left = makeBinary(left, op, right, line);
+        }
+
+        return left;
+    }
+
+    // Prefix '-' and '!' bind more loosely than '**', so -2 ** 2 is -(2 ** 2).
+    Expression* parseUnary() {
+        int line = currentToken.line;
+        Op op = currentToken.type == TokenType::Operator ? currentToken.op : Op::None;
+
+        if (op == Op::Subtract || op == Op::Not) {
+            advance(); // consume operator
+            return makeUnary(op, parseExpression(precedence(Op::Power)), line);
+        }
+        if (op == Op::Increment || op == Op::Decrement) {
+            advance(); // consume operator
+            return arena.make<UnaryExpression>(op, parsePostfix(), line, true);
+        }
+        return parsePostfix();
+    }
+
+    Expression* parsePostfix() {
+        auto operand = parsePrimary();
+        if (currentToken.op == Op::Increment || currentToken.op == Op::Decrement) {
+            Op op = currentToken.op;
+            int line = currentToken.line;
+            advance(); // consume operator
+            return arena.make<UnaryExpression>(op, operand, line);
+        }
+        return operand;
+    }
+
+    // Constant folding. An operator applied only to literals is evaluated here by the same rules
+    // the interpreter uses and replaced by a single literal. Anything that would fail at run
+    // time, or whose result a literal cannot represent, is left for the interpreter.
+    Expression* makeBinary(Expression* left, Op op, Expression* right, int line) {
+        if (Expression* folded = foldBinary(left, op, right, line)) {
+            releaseString(left);
+            releaseString(right);
+            return folded;
+        }
+        return arena.make<BinaryExpression>(left, op, right, line);
+    }
+
+    Expression* makeUnary(Op op, Expression* operand, int line) {
+        const auto* number = nodeCast<const NumberExpression>(operand);
+        if (op == Op::Subtract && number) {
+            if (number->isDouble) {
+                return arena.make<NumberExpression>(-number->real, line);
+            }
+            if (Expression* folded = intResult(-number->integer, line)) {
+                return folded;
+            }
+            if (number->integer > INT32_MAX) {
+                return arena.make<NumberExpression>(-number->integer, line); // as in -2147483648
+            }
+        }
+        if (const auto* boolExpr = nodeCast<const BoolExpression>(operand); boolExpr && op == Op::Not) {
+            return arena.make<BoolExpression>(!boolExpr->value, line);
+        }
+        return arena.make<UnaryExpression>(op, operand, line);
+    }
+
+    Expression* foldBinary(const Expression* left, Op op, const Expression* right, int line) {
+        int64_t a, b;
+        if (intLiteral(left, a) && intLiteral(right, b)) {
+            switch (op) {
+                case Op::Add: return intResult(a + b, line);
+                case Op::Subtract: return intResult(a - b, line);
+                case Op::Multiply: return intResult(a * b, line);
+                case Op::Divide: return b == 0 ? nullptr : intResult(a / b, line);
+                case Op::Power: return b < 0 ? nullptr : intResult(checkedPower(a, b), line);
+                case Op::Less: return arena.make<BoolExpression>(a < b, line);
+                case Op::Greater: return arena.make<BoolExpression>(a > b, line);
+                case Op::LessEqual: return arena.make<BoolExpression>(a <= b, line);
+                case Op::GreaterEqual: return arena.make<BoolExpression>(a >= b, line);
+                case Op::Equal: return arena.make<BoolExpression>(a == b, line);
+                case Op::NotEqual: return arena.make<BoolExpression>(a != b, line);
+                default: return nullptr;
+            }
+        }
+
+        const auto* leftString = nodeCast<const StringExpression>(left);
+        const auto* rightString = nodeCast<const StringExpression>(right);
+        if (leftString && rightString) {
+            const std::string& x = Symbols::name(leftString->value);
+            const std::string& y = Symbols::name(rightString->value);
+            switch (op) {
+                case Op::Add: return arena.make<StringExpression>(lexer.internLiteral(x + y), line);
+                case Op::Less: return arena.make<BoolExpression>(x < y, line);
+                case Op::Greater: return arena.make<BoolExpression>(x > y, line);
+                case Op::LessEqual: return arena.make<BoolExpression>(x <= y, line);
+                case Op::GreaterEqual: return arena.make<BoolExpression>(x >= y, line);
+                case Op::Equal: return arena.make<BoolExpression>(x == y, line);
+                case Op::NotEqual: return arena.make<BoolExpression>(x != y, line);
+                default: return nullptr;
+            }
+        }
+
+        // A string added to any other literal concatenates its printed form.
+        std::string leftText, rightText;
+        if (op == Op::Add && (leftString || rightString) && literalText(left, leftText) && literalText(right, rightText)) {
+            return arena.make<StringExpression>(lexer.internLiteral(leftText + rightText), line);
+        }
+
+        const auto* leftBool = nodeCast<const BoolExpression>(left);
+        const auto* rightBool = nodeCast<const BoolExpression>(right);
+        if (leftBool && rightBool && (op == Op::Equal || op == Op::NotEqual)) {
+            return arena.make<BoolExpression>((leftBool->value == rightBool->value) == (op == Op::Equal), line);
+        }
+        return nullptr;
+    }
+
+    // Only integer literals are folded, and only those within the int range.
+    static bool intLiteral(const Expression* expr, int64_t& value) {
+        const auto* number = nodeCast<const NumberExpression>(expr);
+        if (!number || number->isDouble || number->integer < INT32_MIN || number->integer > INT32_MAX) {
+            return false;
+        }
+        value = number->integer;
+        return true;
+    }
+
+    // Hands back the symbol of a string literal that folding has dropped; see Symbols.
+    static void releaseString(const Expression* expr) {
+        if (const auto* stringExpr = nodeCast<const StringExpression>(expr)) {
+            Symbols::release(stringExpr->value);
+        }
+    }
+
+    static bool literalText(const Expression* expr, std::string& text) {
+        int64_t number;
+        if (const auto* stringExpr = nodeCast<const StringExpression>(expr)) {
+            text = Symbols::name(stringExpr->value);
+        } else if (const auto* boolExpr = nodeCast<const BoolExpression>(expr)) {
+            text = boolExpr->value ? "1" : "0";
+        } else if (intLiteral(expr, number)) {
+            text = std::to_string(number);
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    // base ** exponent for a non-negative exponent, or a value outside the int range once the
+    // result no longer fits.
+    static int64_t checkedPower(int64_t base, int64_t exponent) {
+        constexpr int64_t OVERFLOW_MARK = int64_t(INT32_MAX) + 1;
+        int64_t result = 1;
+        while (exponent > 0) {
+            if (exponent & 1) {
+                result *= base;
+                if (result > INT32_MAX || result < INT32_MIN) {
+                    return OVERFLOW_MARK;
+                }
+            }
+            exponent >>= 1;
+            if (exponent > 0) {
+                base *= base; // still to be multiplied in, so the result would not fit either
+                if (base > INT32_MAX) {
+                    return OVERFLOW_MARK;
+                }
+            }
+        }
+        return result;
+    }
+
+    Expression* intResult(int64_t value, int line) {
+        if (value > INT32_MAX || value < INT32_MIN) {
+            return nullptr;
+        }
+        return arena.make<NumberExpression>(value, line);
+    }
+
+    Expression* parsePrimary() {
+        int line = currentToken.line;
+
+        if (currentToken.type == TokenType::Number) {
+            Expression* number = currentToken.isDouble ? arena.make<NumberExpression>(currentToken.real, line)
+                                                       : arena.make<NumberExpression>(currentToken.integer, line);
+            advance(); // consume number
+            return number;
+        }
+
+        if (currentToken.type == TokenType::Identifier) {
+            SymbolId name = currentToken.symbol;
+            advance(); // consume identifier
+
+            if (currentToken.sym == Sym::LeftBracket) {
+                advance(); // consume '['
+                auto indexExpr = parseExpression();
+                if (currentToken.sym != Sym::RightBracket) {
+                    throw std::runtime_error("Expected ']' after index at line " + std::to_string(currentToken.line));
+                }
+                advance(); // consume ']'
+                return arena.make<IndexExpression>(arena.make<VariableExpression>(name, line), indexExpr, line);
+            }
+
+            if (currentToken.sym == Sym::LeftParen) {
+                advance(); // consume '('
+                std::vector<Expression*> arguments;
+                while (currentToken.sym != Sym::RightParen) {
+                    arguments.push_back(parseExpression());
+                    if (currentToken.sym == Sym::Comma) {
+                        advance(); // consume ','
+                    } else if (currentToken.sym == Sym::RightParen) {
+                        break;
+                    } else {
+                        throw std::runtime_error("Expected ',' or ')' in function call at line " + std::to_string(currentToken.line));
+                    }
+                }
+                advance(); // consume ')'
+                return arena.make<FunctionCallExpression>(name, arena.list(arguments), line);
+            }
+
+            return arena.make<VariableExpression>(name, line);
+        }
+
+        if (currentToken.sym == Sym::LeftParen) {
+            advance(); // consume '('
+            auto expr = parseExpression();
+            if (currentToken.sym != Sym::RightParen) {
+                throw std::runtime_error("Expected ')' after expression at line " + std::to_string(currentToken.line));
+            }
+            advance(); // consume ')'
+            return expr;
+        }
+
+        if (currentToken.type == TokenType::StringLiteral) {
+            SymbolId value = currentToken.symbol;
+            advance(); // consume string literal
+            return arena.make<StringExpression>(value, line);
+        }
+
+        if (currentToken.keyword == Keyword::True || currentToken.keyword == Keyword::False) {
+            bool value = (currentToken.keyword == Keyword::True);
+            advance(); // consume 'true' or 'false'
+            return arena.make<BoolExpression>(value, line);
+        }
+
+        if (currentToken.sym == Sym::LeftBracket) {
+            // Array or list parsing
+            advance(); // consume '['
+            std::vector<Expression*> elements;
+            while (currentToken.sym != Sym::RightBracket) {
+                elements.push_back(parseExpression());
+                if (currentToken.sym == Sym::Comma) {
+                    advance(); // consume ','
+                } else if (currentToken.sym == Sym::RightBracket) {
+                    break;
+                } else {
+                    throw std::runtime_error("Expected ',' or ']' in array or list at line " + std::to_string(currentToken.line));
+                }
+            }
+            advance(); // consume ']'
+            return arena.make<ArrayExpression>(arena.list(elements), line);
+        }
+
+        if (currentToken.keyword == Keyword::Read) {
+            advance(); // consume 'read'
+            if (currentToken.sym != Sym::LeftParen) {
+                throw std::runtime_error("Expected '(' after 'read' at line " + std::to_string(currentToken.line));
+            }
+            advance(); // consume '('
+            Expression* prompt = nullptr;
+            if (currentToken.sym != Sym::RightParen) {
+                prompt = parseExpression();
+            }
+            if (currentToken.sym != Sym::RightParen) {
+                throw std::runtime_error("Expected ')' after 'read' argument at line " + std::to_string(currentToken.line));
+            }
+            advance(); // consume ')'
+            return arena.make<ReadExpression>(prompt, line);
+        }
+
+        throw std::runtime_error("Expected primary expression at line " + std::to_string(currentToken.line));
+    }
+
+    Statement* parseFunctionDeclaration() {
+        int line = currentToken.line;
+        advance(); // consume 'func'
+
+        if (currentToken.type != TokenType::Identifier) {
+            throw std::runtime_error("Expected function name in declaration at line " + std::to_string(line));
+        }
+        SymbolId name = currentToken.symbol;
+        advance(); // consume function name
+
+        if (currentToken.sym != Sym::LeftParen) {
+            throw std::runtime_error("Expected '(' after function name at line " + std::to_string(line));
+        }
+        advance(); // consume '('
+
+        std::vector<SymbolId> parameters;
+        while (currentToken.sym != Sym::RightParen) {
+            if (currentToken.type != TokenType::Identifier) {
+                throw std::runtime_error("Expected parameter name at line " + std::to_string(line));
+            }
+            parameters.push_back(currentToken.symbol);
+            advance(); // consume parameter
+
+            if (currentToken.sym == Sym::Comma) {
+                advance(); // consume ','
+            } else if (currentToken.sym != Sym::RightParen) {
+                throw std::runtime_error("Expected ',' or ')' after parameter at line " + std::to_string(line));
+            }
+        }
+        advance(); // consume ')'
+
+        if (currentToken.sym != Sym::LeftBrace) {
+            throw std::runtime_error("Expected '{' before function body at line " + std::to_string(line));
+        }
+        if (lazyFunctions && lookaheadCount == 0) {
+            // The lexer stands right after the '{', so it can skip the body in one scan.
+            size_t bodyOffset = currentToken.offset + 1;
+            int bodyLine = currentToken.line;
+            lexer.skipBlock();
+            advance(); // the token after the closing '}'
+            return arena.make<FunctionDeclaration>(name, std::move(parameters), lexer.text(), bodyOffset, bodyLine, line);
+        }
+        advance(); // consume '{'
+
+        std::vector<Statement*> body;
+        while (currentToken.sym != Sym::RightBrace) {
+            body.push_back(parseRequiredStatement());
+        }
+        advance(); // consume '}'
+
+        return arena.make<FunctionDeclaration>(name, std::move(parameters), arena.list(body), line);
+    }
+
+    Statement* parseIfStatement() {
+        int line = currentToken.line;
+        advance(); // consume 'if'
+
+        if (currentToken.sym != Sym::LeftParen) {
+            throw std::runtime_error("Expected '(' after 'if' at line " + std::to_string(line));
+        }
+        advance(); // consume '('
+
+        auto condition = parseExpression();
+
+        if (currentToken.sym != Sym::RightParen) {
+            throw std::runtime_error("Expected ')' after condition at line " + std::to_string(line));
+        }
+        advance(); // consume ')'
+
+        auto thenBranch = parseBlock();
+        Statement* elseBranch = nullptr;
+
+        if (currentToken.keyword == Keyword::Else) {
+            advance(); // consume 'else'
+            elseBranch = parseBlock();
+        }
+
+        return arena.make<IfStatement>(condition, thenBranch, elseBranch, line);
+    }
+
+    Statement* parseReturnStatement() {
+        int line = currentToken.line;
+        advance(); // consume 'return'
+
+        auto expression = parseExpression();
+
+        if (currentToken.sym == Sym::Semicolon) {
+            advance(); // consume optional ';'
+        } else if (currentToken.sym != Sym::RightBrace && currentToken.type != TokenType::EndOfFile) {
+            throw std::runtime_error("Expected ';' after 'return' statement at line " + std::to_string(line));
+        }
+
+        return arena.make<ReturnStatement>(expression, line);
+    }
+
+    Statement* parseForStatement() {
+        int line = currentToken.line;
+        advance(); // consume 'for'
+
+        if (currentToken.sym != Sym::LeftParen) {
+            throw std::runtime_error("Expected '(' after 'for' at line " + std::to_string(line));
+        }
+        advance(); // consume '('
+
+        auto initializer = parseRequiredStatement(); // the initializer consumes its own ';'
+
+        auto condition = parseExpression();
+
+        if (currentToken.sym != Sym::Semicolon) {
+            throw std::runtime_error("Expected ';' after condition in 'for' statement at line " + std::to_string(line));
+        }
+        advance(); // consume ';'
+
+        int incrementLine = currentToken.line;
+        auto increment = arena.make<ExpressionStatement>(parseExpression(), incrementLine);
+
+        if (currentToken.sym != Sym::RightParen) {
+            throw std::runtime_error("Expected ')' after increment in 'for' statement at line " + std::to_string(line));
+        }
+        advance(); // consume ')'
+
+        auto body = parseBlock();
+
+        return arena.make<ForStatement>(initializer, condition, increment, body, line);
+    }
+
+    Statement* parseWhileStatement() {
+        int line = currentToken.line;
+        advance(); // consume 'while'
+
+        if (currentToken.sym != Sym::LeftParen) {
+            throw std::runtime_error("Expected '(' after 'while' at line " + std::to_string(line));
+        }
+        advance(); // consume '('
+
+        auto condition = parseExpression();
+
+        if (currentToken.sym != Sym::RightParen) {
+            throw std::runtime_error("Expected ')' after condition at line " + std::to_string(line));
+        }
+        advance(); // consume ')'
+
+        auto body = parseBlock();
+
+        return arena.make<WhileStatement>(condition, body, line);
+    }
+
+    Statement* parseIncludeStatement() {
+        int line = currentToken.line;
+        advance(); // consume 'include'
+
+        if (currentToken.type != TokenType::StringLiteral) {
+            throw std::runtime_error("Expected string literal after 'include' at line " + std::to_string(line));
+        }
+
+        SymbolId fileName = currentToken.symbol;
+        advance(); // consume string literal
+
+        if (currentToken.sym == Sym::Semicolon) {
+            advance(); // consume optional ';'
+        } else if (currentToken.sym != Sym::RightBrace && currentToken.type != TokenType::EndOfFile) {
+            throw std::runtime_error("Expected ';' after 'include' statement at line " + std::to_string(line));
+        }
+
+        return arena.make<IncludeStatement>(fileName, line);
+    }
+
+    Statement* parseBlock() {
+        if (currentToken.sym != Sym::LeftBrace) {
+            return parseRequiredStatement();
+        }
+
+        int line = currentToken.line;
+        advance(); // consume '{'
+
+        std::vector<Statement*> statements;
+        while (currentToken.sym != Sym::RightBrace) {
+            statements.push_back(parseRequiredStatement());
+        }
+        advance(); // consume '}'
+
+        return arena.make<BlockStatement>(arena.list(statements), line);
+    }
+
+    Statement* parseExpressionStatement() {
+        int line = currentToken.line;
+        auto expr = parseExpression();
+
+        if (currentToken.type == TokenType::EndOfFile || currentToken.sym == Sym::Semicolon) {
+            if (currentToken.type != TokenType::EndOfFile) {
+                advance(); // consume ';'
+            }
+            return arena.make<ExpressionStatement>(expr, line);
+        } else {
+            throw std::runtime_error("Expected ';' after expression statement at line " + std::to_string(currentToken.line));
+        }
+    }
+};
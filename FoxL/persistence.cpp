@@ -0,0 +1,341 @@
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// When declared globals are handed to the background writer: on a declaration made at least
+// the given number of milliseconds after the last batch (nothing is written while no
+// declarations happen), once the given number of declarations has accumulated, or only on
+// sync() and at exit.
+struct PersistPolicy {
+    enum class Mode {
+        Interval,
+        Count,
+        Exit
+    };
+
+    Mode mode = Mode::Interval;
+    int amount = 100;
+
+    // Accepts "interval:<ms>", "count:<records>" or "exit".
+    static PersistPolicy parse(const std::string& text) {
+        PersistPolicy policy;
+        std::string mode = text.substr(0, text.find(':'));
+        if (mode == "exit" && mode.size() == text.size()) {
+            policy.mode = Mode::Exit;
+            policy.amount = 0;
+            return policy;
+        }
+        if (mode == "interval") {
+            policy.mode = Mode::Interval;
+        } else if (mode == "count") {
+            policy.mode = Mode::Count;
+        } else {
+            throw std::runtime_error("Unknown persistence policy " + text);
+        }
+        if (mode.size() == text.size()) {
+            throw std::runtime_error("Persistence policy " + text + " needs an amount");
+        }
+        try {
+            size_t used = 0;
+            policy.amount = std::stoi(text.substr(mode.size() + 1), &used);
+            if (used != text.size() - mode.size() - 1 || policy.amount < 1) {
+                throw std::invalid_argument(text);
+            }
+        } catch (const std::logic_error&) {
+            throw std::runtime_error("Invalid amount in persistence policy " + text);
+        }
+        return policy;
+    }
+};
+
+// The data file format: an 8-byte magic and a u32 version, followed by any number of records.
+// A record is a flags byte (bit 0: constant), a ValueType byte and a length-prefixed name,
+// then the value: int as i32, double as f64, bool as one byte, string as length + bytes, int
+// array as count + contiguous i32s, string array as count + a table of lengths + the bytes.
+// Lengths and counts are u32; everything is in host byte order. Records for the same name
+// may repeat, and the last one wins, so batches can simply be appended.
+class Snapshot {
+public:
+    static constexpr char MAGIC[8] = { 'F', 'o', 'x', 'L', 'D', 'a', 't', '\0' };
+    static constexpr uint32_t VERSION = 1;
+    static constexpr size_t HEADER_SIZE = sizeof(MAGIC) + sizeof(uint32_t);
+
+    static std::string header() {
+        std::string out(MAGIC, sizeof(MAGIC));
+        writeU32(out, VERSION);
+        return out;
+    }
+
+    static bool isSnapshot(const char* data, size_t size) {
+        return size >= sizeof(MAGIC) && std::memcmp(data, MAGIC, sizeof(MAGIC)) == 0;
+    }
+
+    static void writeRecord(std::string& out, const std::string& name, const Value& value, bool isConstant) {
+        out.push_back(static_cast<char>(isConstant ? 1 : 0));
+        out.push_back(static_cast<char>(value.type()));
+        writeString(out, name);
+        switch (value.type()) {
+            case ValueType::Int:
+                writeRaw(out, value.asInt());
+                break;
+            case ValueType::Double:
+                writeRaw(out, value.asDouble());
+                break;
+            case ValueType::Bool:
+                out.push_back(static_cast<char>(value.asBool() ? 1 : 0));
+                break;
+            case ValueType::String:
+                writeString(out, value.asString());
+                break;
+            case ValueType::IntArray: {
+                const auto& values = value.asIntArray();
+                writeU32(out, static_cast<uint32_t>(values.size()));
+                out.append(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(int));
+                break;
+            }
+            case ValueType::StringArray: {
+                const auto& values = value.asStringArray();
+                writeU32(out, static_cast<uint32_t>(values.size()));
+                for (const auto& element : values) {
+                    writeU32(out, static_cast<uint32_t>(element.size()));
+                }
+                for (const auto& element : values) {
+                    out += element;
+                }
+                break;
+            }
+        }
+    }
+
+    // Calls onRecord(name, value, isConstant) for every complete record. A record cut short,
+    // as left behind by a crash during an append, ends the snapshot.
+    template <typename F>
+    static void read(const char* data, size_t size, F&& onRecord) {
+        if (size < HEADER_SIZE) {
+            return;
+        }
+        uint32_t version;
+        std::memcpy(&version, data + sizeof(MAGIC), sizeof(version));
+        if (version != VERSION) {
+            throw std::runtime_error("Unsupported data file version " + std::to_string(version));
+        }
+
+        Reader in{ data + HEADER_SIZE, data + size };
+        while (in.position < in.end) {
+            uint8_t flags, type;
+            std::string name;
+            if (!in.readRaw(flags) || !in.readRaw(type) || !in.readString(name)) {
+                return;
+            }
+
+            Value value;
+            switch (static_cast<ValueType>(type)) {
+                case ValueType::Int: {
+                    int number;
+                    if (!in.readRaw(number)) {
+                        return;
+                    }
+                    value = number;
+                    break;
+                }
+                case ValueType::Double: {
+                    double number;
+                    if (!in.readRaw(number)) {
+                        return;
+                    }
+                    value = number;
+                    break;
+                }
+                case ValueType::Bool: {
+                    uint8_t flag;
+                    if (!in.readRaw(flag)) {
+                        return;
+                    }
+                    value = flag != 0;
+                    break;
+                }
+                case ValueType::String: {
+                    std::string text;
+                    if (!in.readString(text)) {
+                        return;
+                    }
+                    value = std::move(text);
+                    break;
+                }
+                case ValueType::IntArray: {
+                    uint32_t count;
+                    if (!in.readRaw(count) || !in.has(static_cast<size_t>(count) * sizeof(int))) {
+                        return;
+                    }
+                    std::vector<int> values(count);
+                    std::memcpy(values.data(), in.position, values.size() * sizeof(int));
+                    in.position += values.size() * sizeof(int);
+                    value = std::move(values);
+                    break;
+                }
+                case ValueType::StringArray: {
+                    uint32_t count;
+                    if (!in.readRaw(count) || !in.has(static_cast<size_t>(count) * sizeof(uint32_t))) {
+                        return;
+                    }
+                    const char* lengths = in.position;
+                    in.position += static_cast<size_t>(count) * sizeof(uint32_t);
+                    std::vector<std::string> values;
+                    values.reserve(count);
+                    for (uint32_t i = 0; i < count; ++i) {
+                        uint32_t length;
+                        std::memcpy(&length, lengths + i * sizeof(uint32_t), sizeof(length));
+                        if (!in.has(length)) {
+                            return;
+                        }
+                        values.emplace_back(in.position, length);
+                        in.position += length;
+                    }
+                    value = std::move(values);
+                    break;
+                }
+                default:
+                    return;
+            }
+            onRecord(name, std::move(value), (flags & 1) != 0);
+        }
+    }
+
+private:
+    struct Reader {
+        const char* position;
+        const char* end;
+
+        bool has(size_t count) const {
+            return static_cast<size_t>(end - position) >= count;
+        }
+
+        template <typename T>
+        bool readRaw(T& value) {
+            if (!has(sizeof(T))) {
+                return false;
+            }
+            std::memcpy(&value, position, sizeof(T));
+            position += sizeof(T);
+            return true;
+        }
+
+        bool readString(std::string& text) {
+            uint32_t length;
+            if (!readRaw(length) || !has(length)) {
+                return false;
+            }
+            text.assign(position, length);
+            position += length;
+            return true;
+        }
+    };
+
+    template <typename T>
+    static void writeRaw(std::string& out, const T& value) {
+        out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    static void writeU32(std::string& out, uint32_t value) {
+        writeRaw(out, value);
+    }
+
+    static void writeString(std::string& out, const std::string& text) {
+        writeU32(out, static_cast<uint32_t>(text.size()));
+        out += text;
+    }
+};
+
+// Appends already formatted batches of records to the data file on its own thread, keeping
+// the file open between batches. Batches are plain strings because Values are not safe to
+// share across threads; the interpreter formats them before submitting. A new or empty
+// file is started with the snapshot header.
+class PersistenceWriter {
+public:
+    explicit PersistenceWriter(std::string fileName) : fileName(std::move(fileName)) {}
+
+    ~PersistenceWriter() {
+        stop();
+    }
+
+    void submit(std::string batch) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!worker.joinable()) {
+                worker = std::thread(&PersistenceWriter::run, this);
+            }
+            pending.push_back(std::move(batch));
+            ++submitted;
+        }
+        wake.notify_one();
+    }
+
+    // Blocks until every batch submitted so far has been written and flushed.
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        written.wait(lock, [this] { return completed == submitted; });
+    }
+
+    // Writes out whatever is still queued and stops the thread.
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!worker.joinable()) {
+                return;
+            }
+            stopping = true;
+        }
+        wake.notify_one();
+        worker.join();
+        stopping = false;
+    }
+
+private:
+    std::string fileName;
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable written;
+    std::deque<std::string> pending;
+    uint64_t submitted = 0;
+    uint64_t completed = 0;
+    bool stopping = false;
+
+    void run() {
+        std::error_code error;
+        bool isEmpty = !std::filesystem::exists(fileName, error) || std::filesystem::file_size(fileName, error) == 0;
+        std::ofstream outFile(fileName, std::ios_base::binary | std::ios_base::app);
+        if (isEmpty) {
+            outFile << Snapshot::header();
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+            wake.wait(lock, [this] { return stopping || !pending.empty(); });
+            if (pending.empty()) {
+                return;
+            }
+
+            std::deque<std::string> batches;
+            batches.swap(pending);
+            lock.unlock();
+            for (const auto& batch : batches) {
+                outFile << batch;
+            }
+            outFile.flush();
+            lock.lock();
+
+            completed += batches.size();
+            written.notify_all();
+        }
+    }
+};
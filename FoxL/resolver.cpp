@@ -0,0 +1,261 @@
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Assigns every variable a numeric slot before execution. Declarations at the top level of a
+// script are globals (persisted by name); parameters and declarations inside functions, blocks
+// and `for` initializers are locals in a flat per-frame array. Slots of a closed block are
+// reused by its siblings, so a frame only needs as many slots as its deepest nesting. Once a
+// frame is resolved, TypeInference marks the operators whose operand types it can tell.
+class Resolver {
+public:
+    // Resolves a whole script and returns the number of local slots its top-level frame needs.
+    int resolve(FlatAst& tree, const std::vector<NodeId>& statements) {
+        ast = &tree;
+        functions.push_back({ true, {}, 0, 0 });
+        beginScope();
+        for (NodeId statement : statements) {
+            resolveStatement(statement);
+        }
+        endScope();
+        int slotCount = functions.back().maxSlots;
+        functions.pop_back();
+        types.inferScript(tree, statements, slotCount);
+        return slotCount;
+    }
+
+    // Resolves one function body. Called from resolve() for parsed bodies and by the engines
+    // once a lazily parsed body has been filled in; a body sees only its own locals and the
+    // globals, so it resolves the same whenever that happens.
+    void resolveFunction(FlatAst& tree, uint32_t function) {
+        ast = &tree;
+        const FlatAst::Function& entry = tree.functions[function];
+        functions.push_back({ false, {}, 0, 0 });
+        beginScope();
+        for (uint32_t i = 0; i < entry.parameterCount; ++i) {
+            declareLocal(tree.parameterNames[entry.parameters + i], false, entry.line);
+        }
+        for (uint32_t i = 0; i < entry.bodyCount; ++i) {
+            resolveStatement(tree.children[entry.body + i]);
+        }
+        endScope();
+        tree.functions[function].slotCount = functions.back().maxSlots;
+        functions.pop_back();
+        types.inferFunction(tree, function);
+    }
+
+    const std::vector<SymbolId>& globalNames() const {
+        return globals;
+    }
+
+private:
+    struct Local {
+        int slot;
+        bool isConstant;
+    };
+
+    struct FunctionScope {
+        bool isScript;
+        std::vector<std::unordered_map<SymbolId, Local>> scopes;
+        int nextSlot;
+        int maxSlots;
+    };
+
+    FlatAst* ast = nullptr;
+    std::vector<FunctionScope> functions;
+    std::unordered_map<SymbolId, int> globalSlots;
+    std::vector<SymbolId> globals;
+    TypeInference types;
+
+    void beginScope() {
+        functions.back().scopes.emplace_back();
+    }
+
+    void endScope() {
+        FunctionScope& function = functions.back();
+        function.nextSlot -= static_cast<int>(function.scopes.back().size());
+        function.scopes.pop_back();
+    }
+
+    bool isGlobalScope() const {
+        return functions.back().isScript && functions.back().scopes.size() == 1;
+    }
+
+    int globalSlot(SymbolId name) {
+        auto [it, inserted] = globalSlots.try_emplace(name, static_cast<int>(globals.size()));
+        if (inserted) {
+            globals.push_back(name);
+        }
+        return it->second;
+    }
+
+    const Local* findLocal(SymbolId name) const {
+        const auto& scopes = functions.back().scopes;
+        for (auto it = scopes.rbegin(); it != scopes.rend(); ++it) {
+            auto found = it->find(name);
+            if (found != it->end()) {
+                return &found->second;
+            }
+        }
+        return nullptr;
+    }
+
+    int declareLocal(SymbolId name, bool isConstant, int line) {
+        FunctionScope& function = functions.back();
+        auto& scope = function.scopes.back();
+        auto it = scope.find(name);
+        if (it != scope.end()) {
+            if (it->second.isConstant) {
+                throw std::runtime_error("Cannot reassign constant variable: " + Symbols::name(name) + " at line " + std::to_string(line));
+            }
+            it->second.isConstant = isConstant;
+            return it->second.slot;
+        }
+        int slot = function.nextSlot++;
+        function.maxSlots = std::max(function.maxSlots, function.nextSlot);
+        scope[name] = { slot, isConstant };
+        return slot;
+    }
+
+    // Records where a variable lives: `slot` goes to operand `slots` (c for declarations, b
+    // for uses) and IS_LOCAL to the flags.
+    void setSlot(NodeId id, std::vector<uint32_t>& slots, bool isLocal, int slot) {
+        slots[id] = static_cast<uint32_t>(slot);
+        ast->flags[id] = isLocal ? (ast->flags[id] | FlatAst::IS_LOCAL) : (ast->flags[id] & ~FlatAst::IS_LOCAL);
+    }
+
+    void resolveBody(NodeId statement) {
+        beginScope();
+        resolveStatement(statement);
+        endScope();
+    }
+
+    void resolveStatement(NodeId statement) {
+        if (statement == NO_NODE) {
+            return;
+        }
+
+        uint32_t a = ast->a[statement];
+        uint32_t b = ast->b[statement];
+        switch (ast->kinds[statement]) {
+            case NodeKind::WriteStatement:
+            case NodeKind::ExpressionStatement:
+            case NodeKind::ReturnStatement:
+                resolveExpression(a);
+                break;
+            case NodeKind::VariableDeclaration: {
+                resolveExpression(b);
+                if (isGlobalScope()) {
+                    setSlot(statement, ast->c, false, globalSlot(a));
+                } else {
+                    bool isConstant = (ast->flags[statement] & FlatAst::IS_CONSTANT) != 0;
+                    setSlot(statement, ast->c, true, declareLocal(a, isConstant, ast->lines[statement]));
+                }
+                break;
+            }
+            case NodeKind::FunctionDeclaration:
+                if (!ast->functions[a].isLazy()) {
+                    resolveFunction(*ast, a);
+                }
+                break;
+            case NodeKind::IfStatement: {
+                NodeId elseBranch = ast->c[statement];
+                resolveExpression(a);
+                resolveBody(b);
+                resolveBody(elseBranch);
+                break;
+            }
+            case NodeKind::ForStatement: {
+                const NodeId* parts = &ast->children[a];
+                NodeId initializer = parts[0], condition = parts[1], increment = parts[2], body = parts[3];
+                beginScope();
+                resolveStatement(initializer);
+                resolveExpression(condition);
+                resolveBody(body);
+                resolveStatement(increment);
+                endScope();
+                break;
+            }
+            case NodeKind::WhileStatement:
+                resolveExpression(a);
+                resolveBody(b);
+                break;
+            case NodeKind::BlockStatement:
+                beginScope();
+                for (uint32_t i = 0; i < b; ++i) {
+                    resolveStatement(ast->children[a + i]);
+                }
+                endScope();
+                break;
+            default:
+                break;
+        }
+    }
+
+    void checkAssignable(NodeId target, int line) {
+        if (ast->kinds[target] == NodeKind::IndexExpression) {
+            target = ast->a[target];
+        }
+        if (ast->kinds[target] == NodeKind::VariableExpression) {
+            SymbolId name = ast->a[target];
+            const Local* local = findLocal(name);
+            if (local && local->isConstant) {
+                throw std::runtime_error("Cannot reassign constant variable: " + Symbols::name(name) + " at line " + std::to_string(line));
+            }
+        }
+    }
+
+    void resolveExpression(NodeId expr) {
+        if (expr == NO_NODE) {
+            return;
+        }
+
+        uint32_t a = ast->a[expr];
+        uint32_t b = ast->b[expr];
+        switch (ast->kinds[expr]) {
+            case NodeKind::VariableExpression:
+                if (const Local* local = findLocal(a)) {
+                    setSlot(expr, ast->b, true, local->slot);
+                } else {
+                    setSlot(expr, ast->b, false, globalSlot(a));
+                }
+                break;
+            case NodeKind::BinaryExpression:
+                if (ast->ops[expr] == Op::Assign) {
+                    checkAssignable(a, ast->lines[expr]);
+                }
+                resolveExpression(a);
+                resolveExpression(b);
+                break;
+            case NodeKind::UnaryExpression:
+                if (ast->ops[expr] == Op::Increment || ast->ops[expr] == Op::Decrement) {
+                    checkAssignable(a, ast->lines[expr]);
+                }
+                resolveExpression(a);
+                break;
+            case NodeKind::ReadExpression:
+                resolveExpression(a);
+                break;
+            case NodeKind::IndexExpression:
+                resolveExpression(a);
+                resolveExpression(b);
+                break;
+            case NodeKind::ArrayExpression:
+                for (uint32_t i = 0; i < b; ++i) {
+                    resolveExpression(ast->children[a + i]);
+                }
+                break;
+            case NodeKind::FunctionCallExpression: {
+                uint32_t count = ast->c[expr];
+                for (uint32_t i = 0; i < count; ++i) {
+                    resolveExpression(ast->children[b + i]);
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+};
@@ -0,0 +1,198 @@
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define FOXL_HAVE_X86_SIMD 1
+#endif
+
+// The byte scans the lexer spends most of its time in. On x86-64 each has an SSE2 and an AVX2
+// version that look at 16 or 32 bytes per step; which one runs is picked once, from what the
+// CPU supports. Elsewhere they are plain loops. Every scan starts at `position` and returns the
+// position it stopped at, or the size of the text when it ran off the end.
+class TextScan {
+public:
+    // Skips whitespace, adding the newlines it passes to `line`.
+    static size_t skipSpace(std::string_view text, size_t position, int& line) {
+        if (position >= text.size()) {
+            return text.size();
+        }
+        return offset(text, kernels().skipSpace(text.data() + position, text.data() + text.size(), line));
+    }
+
+    static size_t findNewline(std::string_view text, size_t position) {
+        if (position >= text.size()) {
+            return text.size();
+        }
+        const void* found = std::memchr(text.data() + position, '\n', text.size() - position);
+        return found ? offset(text, static_cast<const char*>(found)) : text.size();
+    }
+
+    // Finds the next `quote` or backslash, the only bytes that end a run of string literal.
+    static size_t findQuoteOrBackslash(std::string_view text, size_t position, char quote) {
+        if (position >= text.size()) {
+            return text.size();
+        }
+        return offset(text, kernels().findQuoteOrBackslash(text.data() + position, text.data() + text.size(), quote));
+    }
+
+    // Finds the next byte that matters when skipping a block unparsed: a newline, a brace, a
+    // '/' that may start a comment, or a quote that starts a string.
+    static size_t findBlockByte(std::string_view text, size_t position) {
+        if (position >= text.size()) {
+            return text.size();
+        }
+        return offset(text, kernels().findBlockByte(text.data() + position, text.data() + text.size()));
+    }
+
+private:
+    struct Kernels {
+        const char* (*skipSpace)(const char* position, const char* end, int& line);
+        const char* (*findQuoteOrBackslash)(const char* position, const char* end, char quote);
+        const char* (*findBlockByte)(const char* position, const char* end);
+    };
+
+    static size_t offset(std::string_view text, const char* position) {
+        return static_cast<size_t>(position - text.data());
+    }
+
+    static bool isSpace(char ch) {
+        return ch == ' ' || (ch >= '\t' && ch <= '\r');
+    }
+
+    static bool isBlockByte(char ch) {
+        return ch == '\n' || ch == '{' || ch == '}' || ch == '/' || ch == '\'' || ch == '"';
+    }
+
+    static const Kernels& kernels() {
+        static const Kernels selected = select();
+        return selected;
+    }
+
+    static Kernels select() {
+#ifdef FOXL_HAVE_X86_SIMD
+        if (__builtin_cpu_supports("avx2")) {
+            return { skipSpaceAvx2, findQuoteOrBackslashAvx2, findBlockByteAvx2 };
+        }
+        return { skipSpaceSse2, findQuoteOrBackslashSse2, findBlockByteSse2 };
+#else
+        return { skipSpaceScalar, findQuoteOrBackslashScalar, findBlockByteScalar };
+#endif
+    }
+
+    static const char* skipSpaceScalar(const char* position, const char* end, int& line) {
+        for (; position < end && isSpace(*position); ++position) {
+            line += *position == '\n';
+        }
+        return position;
+    }
+
+    static const char* findQuoteOrBackslashScalar(const char* position, const char* end, char quote) {
+        while (position < end && *position != quote && *position != '\\') {
+            ++position;
+        }
+        return position;
+    }
+
+    static const char* findBlockByteScalar(const char* position, const char* end) {
+        while (position < end && !isBlockByte(*position)) {
+            ++position;
+        }
+        return position;
+    }
+
+#ifdef FOXL_HAVE_X86_SIMD
+    // In both widths a byte is whitespace when it is ' ' or, less 9, at most 4 ('\t' to '\r');
+    // movemask turns the per-byte results into one bit per byte.
+    static const char* skipSpaceSse2(const char* position, const char* end, int& line) {
+        for (; end - position >= 16; position += 16) {
+            __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(position));
+            __m128i control = _mm_sub_epi8(bytes, _mm_set1_epi8('\t'));
+            __m128i space = _mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(control, _mm_set1_epi8(4)), control),
+                                         _mm_cmpeq_epi8(bytes, _mm_set1_epi8(' ')));
+            uint32_t newlines = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('\n'))));
+            uint32_t other = ~static_cast<uint32_t>(_mm_movemask_epi8(space)) & 0xffff;
+            if (other != 0) {
+                unsigned length = static_cast<unsigned>(__builtin_ctz(other));
+                line += __builtin_popcount(newlines & ((1u << length) - 1));
+                return position + length;
+            }
+            line += __builtin_popcount(newlines);
+        }
+        return skipSpaceScalar(position, end, line);
+    }
+
+    static const char* findQuoteOrBackslashSse2(const char* position, const char* end, char quote) {
+        for (; end - position >= 16; position += 16) {
+            __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(position));
+            __m128i found = _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(quote)), _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\\')));
+            if (uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(found))) {
+                return position + __builtin_ctz(mask);
+            }
+        }
+        return findQuoteOrBackslashScalar(position, end, quote);
+    }
+
+    static const char* findBlockByteSse2(const char* position, const char* end) {
+        for (; end - position >= 16; position += 16) {
+            __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(position));
+            __m128i found = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(bytes, _mm_set1_epi8('/'))),
+                _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('{')), _mm_cmpeq_epi8(bytes, _mm_set1_epi8('}'))),
+                             _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('\'')), _mm_cmpeq_epi8(bytes, _mm_set1_epi8('"')))));
+            if (uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(found))) {
+                return position + __builtin_ctz(mask);
+            }
+        }
+        return findBlockByteScalar(position, end);
+    }
+
+    __attribute__((target("avx2")))
+    static const char* skipSpaceAvx2(const char* position, const char* end, int& line) {
+        for (; end - position >= 32; position += 32) {
+            __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(position));
+            __m256i control = _mm256_sub_epi8(bytes, _mm256_set1_epi8('\t'));
+            __m256i space = _mm256_or_si256(_mm256_cmpeq_epi8(_mm256_min_epu8(control, _mm256_set1_epi8(4)), control),
+                                            _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(' ')));
+            uint32_t newlines = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\n'))));
+            uint32_t other = ~static_cast<uint32_t>(_mm256_movemask_epi8(space));
+            if (other != 0) {
+                unsigned length = static_cast<unsigned>(__builtin_ctz(other));
+                line += __builtin_popcount(newlines & ((1u << length) - 1));
+                return position + length;
+            }
+            line += __builtin_popcount(newlines);
+        }
+        return skipSpaceSse2(position, end, line);
+    }
+
+    __attribute__((target("avx2")))
+    static const char* findQuoteOrBackslashAvx2(const char* position, const char* end, char quote) {
+        for (; end - position >= 32; position += 32) {
+            __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(position));
+            __m256i found = _mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(quote)), _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\\')));
+            if (uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(found))) {
+                return position + __builtin_ctz(mask);
+            }
+        }
+        return findQuoteOrBackslashSse2(position, end, quote);
+    }
+
+    __attribute__((target("avx2")))
+    static const char* findBlockByteAvx2(const char* position, const char* end) {
+        for (; end - position >= 32; position += 32) {
+            __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(position));
+            __m256i found = _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\n')), _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('/'))),
+                _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('{')), _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('}'))),
+                                _mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\'')), _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('"')))));
+            if (uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(found))) {
+                return position + __builtin_ctz(mask);
+            }
+        }
+        return findBlockByteSse2(position, end);
+    }
+#endif
+};
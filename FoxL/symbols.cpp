@@ -0,0 +1,155 @@
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using SymbolId = uint32_t;
+
+// Every identifier and string literal of every file the process parses, interned once to a
+// small integer ID. The lexer interns as it scans, so the passes after it compare and hash
+// names as plain integers and look the text up only to print it. Parsing runs on several
+// threads while includes are preloaded, so interning is serialized by a mutex; name() is not,
+// since the text of an ID never moves: it lives in segments that double in size and are
+// allocated once, and an ID only reaches a thread after the intern() that created it.
+//
+// String literals read from standard input are not interned: only the statement they are in
+// needs them, and a stream has no end to its statements. Each gets a transient ID of its own
+// instead, which release() hands back for reuse once the statement's nodes are dropped. Only
+// the thread running the stream creates and releases these.
+class Symbols {
+public:
+    static SymbolId intern(std::string_view text) {
+        return instance().add(text);
+    }
+
+    static SymbolId internTransient(std::string_view text) {
+        return instance().addTransient(text);
+    }
+
+    // Does nothing for an ID from intern(), which lasts as long as the process.
+    static void release(SymbolId id) {
+        if (id & TRANSIENT) {
+            instance().removeTransient(id);
+        }
+    }
+
+    static const std::string& name(SymbolId id) {
+        return instance().text(id);
+    }
+
+private:
+    struct Entry {
+        SymbolId id = EMPTY;
+        uint32_t hash = 0;
+    };
+
+    static constexpr SymbolId EMPTY = UINT32_MAX;
+    static constexpr SymbolId TRANSIENT = 1u << 31;
+    static constexpr unsigned FIRST_SEGMENT_BITS = 10;
+    static constexpr unsigned SEGMENT_COUNT = 32 - FIRST_SEGMENT_BITS;
+
+    std::mutex mutex;
+    std::vector<Entry> table; // open-addressed over IDs, keeping each entry's hash
+    std::unique_ptr<std::string[]> segments[SEGMENT_COUNT];
+    uint32_t count = 0;
+    std::deque<std::string> transient; // by ID without TRANSIENT; a deque, so texts never move
+    std::vector<uint32_t> freeTransient;
+
+    static Symbols& instance() {
+        static Symbols symbols;
+        return symbols;
+    }
+
+    // Segment k holds IDs from 2^(k+FIRST_SEGMENT_BITS) - 2^FIRST_SEGMENT_BITS on.
+    static unsigned segmentOf(uint32_t biased) {
+        unsigned bits = 0;
+        while (biased >> (bits + 1)) {
+            ++bits;
+        }
+        return bits - FIRST_SEGMENT_BITS;
+    }
+
+    const std::string& text(SymbolId id) const {
+        if (id & TRANSIENT) {
+            return transient[id & ~TRANSIENT];
+        }
+        uint32_t biased = id + (1u << FIRST_SEGMENT_BITS);
+        unsigned segment = segmentOf(biased);
+        return segments[segment][biased - (1u << (segment + FIRST_SEGMENT_BITS))];
+    }
+
+    SymbolId add(std::string_view text) {
+        uint32_t hash = hashText(text);
+        std::lock_guard<std::mutex> lock(mutex);
+        if ((static_cast<size_t>(count) + 1) * 4 > table.size() * 3) {
+            growTable();
+        }
+        size_t mask = table.size() - 1;
+        for (size_t i = hash & mask;; i = (i + 1) & mask) {
+            Entry& entry = table[i];
+            if (entry.id == EMPTY) {
+                if (count == TRANSIENT) {
+                    throw std::runtime_error("Too many distinct names and strings");
+                }
+                uint32_t biased = count + (1u << FIRST_SEGMENT_BITS);
+                unsigned segment = segmentOf(biased);
+                if (!segments[segment]) {
+                    segments[segment].reset(new std::string[size_t(1) << (segment + FIRST_SEGMENT_BITS)]);
+                }
+                segments[segment][biased - (1u << (segment + FIRST_SEGMENT_BITS))] = std::string(text);
+                entry = { count, hash };
+                return count++;
+            }
+            if (entry.hash == hash && this->text(entry.id) == text) {
+                return entry.id;
+            }
+        }
+    }
+
+    SymbolId addTransient(std::string_view text) {
+        uint32_t index;
+        if (!freeTransient.empty()) {
+            index = freeTransient.back();
+            freeTransient.pop_back();
+            transient[index] = std::string(text);
+        } else {
+            index = static_cast<uint32_t>(transient.size());
+            transient.emplace_back(text);
+        }
+        return index | TRANSIENT;
+    }
+
+    void removeTransient(SymbolId id) {
+        std::string& text = transient[id & ~TRANSIENT];
+        std::string().swap(text);
+        freeTransient.push_back(id & ~TRANSIENT);
+    }
+
+    static uint32_t hashText(std::string_view text) {
+        uint32_t hash = 2166136261u;
+        for (char ch : text) {
+            hash = (hash ^ static_cast<unsigned char>(ch)) * 16777619u;
+        }
+        return hash;
+    }
+
+    void growTable() {
+        std::vector<Entry> old(std::max<size_t>(table.size() * 2, 1024), Entry{});
+        old.swap(table);
+        size_t mask = table.size() - 1;
+        for (const Entry& entry : old) {
+            if (entry.id != EMPTY) {
+                size_t i = entry.hash & mask;
+                while (table[i].id != EMPTY) {
+                    i = (i + 1) & mask;
+                }
+                table[i] = entry;
+            }
+        }
+    }
+};
@@ -0,0 +1,335 @@
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Works out which type of value each local slot holds at each point of a script or function
+// body, and marks the binary operators whose operands are then two ints (INT_OPERANDS) or two
+// doubles (DOUBLE_OPERANDS), so the engines can skip checking them. Globals, parameters and
+// whatever calls, reads and indexing return can be of any type. Branches join the types they
+// leave behind, and a loop is walked again until the types at its start stop changing. A
+// statement that fails at run time is skipped past with whatever it had assigned by then, so
+// the types at every point that can fail are joined into those after the statement.
+class TypeInference {
+public:
+    void inferScript(FlatAst& tree, const std::vector<NodeId>& statements, int slotCount) {
+        ast = &tree;
+        slots.assign(static_cast<size_t>(slotCount), Type::Int); // fresh slots hold 0
+        for (NodeId statement : statements) {
+            inferStatement(statement);
+        }
+    }
+
+    void inferFunction(FlatAst& tree, uint32_t function) {
+        ast = &tree;
+        const FlatAst::Function& entry = tree.functions[function];
+        slots.assign(static_cast<size_t>(entry.slotCount), Type::Int);
+        for (uint32_t i = 0; i < entry.parameterCount; ++i) {
+            slots[i] = Type::Any;
+        }
+        for (uint32_t i = 0; i < entry.bodyCount; ++i) {
+            inferStatement(tree.children[entry.body + i]);
+        }
+    }
+
+private:
+    enum class Type : uint8_t {
+        Int,
+        Double,
+        Bool,
+        String,
+        Any
+    };
+
+    // The types at every point a statement can fail, joined.
+    struct Failure {
+        std::vector<Type> slots;
+        bool any;
+    };
+
+    FlatAst* ast = nullptr;
+    std::vector<Type> slots;        // at the point being inferred
+    std::vector<Failure> failures;  // of the statements being inferred, innermost at depth - 1
+    size_t depth = 0;
+    std::vector<std::vector<Type>> spare; // copies of `slots` to reuse; one pass infers many frames
+
+    static Type join(Type a, Type b) {
+        return a == b ? a : Type::Any;
+    }
+
+    static bool isNumber(Type type) {
+        return type == Type::Int || type == Type::Double;
+    }
+
+    static void joinInto(std::vector<Type>& into, const std::vector<Type>& from) {
+        for (size_t i = 0; i < into.size(); ++i) {
+            into[i] = join(into[i], from[i]);
+        }
+    }
+
+    std::vector<Type> copySlots() {
+        std::vector<Type> copy;
+        if (!spare.empty()) {
+            copy = std::move(spare.back());
+            spare.pop_back();
+        }
+        copy.assign(slots.begin(), slots.end());
+        return copy;
+    }
+
+    void recycle(std::vector<Type>& copy) {
+        spare.push_back(std::move(copy));
+    }
+
+    // Called where the running statement may throw, with the slots as they are at that point.
+    void mayFail() {
+        Failure& failure = failures[depth - 1];
+        if (failure.any) {
+            joinInto(failure.slots, slots);
+        } else {
+            failure.slots.assign(slots.begin(), slots.end());
+            failure.any = true;
+        }
+    }
+
+    void assign(NodeId variable, Type type) {
+        if (ast->flags[variable] & FlatAst::IS_LOCAL) {
+            slots[ast->b[variable]] = type;
+        } else {
+            mayFail(); // undefined or constant
+        }
+    }
+
+    void inferStatement(NodeId statement) {
+        if (statement == NO_NODE) {
+            return;
+        }
+        if (failures.size() == depth) {
+            failures.emplace_back();
+        }
+        failures[depth++].any = false;
+        inferStatementBody(statement);
+        if (failures[--depth].any) {
+            joinInto(slots, failures[depth].slots);
+        }
+    }
+
+    void inferStatementBody(NodeId statement) {
+        uint32_t a = ast->a[statement];
+        uint32_t b = ast->b[statement];
+        switch (ast->kinds[statement]) {
+            case NodeKind::WriteStatement:
+            case NodeKind::ExpressionStatement:
+            case NodeKind::ReturnStatement:
+                inferExpression(a);
+                break;
+            case NodeKind::VariableDeclaration: {
+                Type type = b != NO_NODE ? inferExpression(b) : Type::Int;
+                if (ast->flags[statement] & FlatAst::IS_LOCAL) {
+                    slots[ast->c[statement]] = type;
+                } else {
+                    mayFail(); // a constant global
+                }
+                break;
+            }
+            case NodeKind::IfStatement: {
+                inferCondition(a);
+                std::vector<Type> before = copySlots();
+                inferStatement(b);
+                std::swap(before, slots);
+                inferStatement(ast->c[statement]);
+                joinInto(slots, before);
+                recycle(before);
+                break;
+            }
+            case NodeKind::ForStatement: {
+                const NodeId* parts = &ast->children[a];
+                NodeId condition = parts[1], increment = parts[2], body = parts[3];
+                inferStatement(parts[0]);
+                inferLoop(condition, body, increment);
+                break;
+            }
+            case NodeKind::WhileStatement:
+                inferLoop(a, b, NO_NODE);
+                break;
+            case NodeKind::BlockStatement:
+                for (uint32_t i = 0; i < b; ++i) {
+                    inferStatement(ast->children[a + i]);
+                }
+                break;
+            case NodeKind::IncludeStatement:
+                mayFail();
+                break;
+            default:
+                break;
+        }
+    }
+
+    void inferCondition(NodeId condition) {
+        if (inferExpression(condition) != Type::Bool) {
+            mayFail();
+        }
+    }
+
+    // Ends with the slots as they are when the condition turns false.
+    void inferLoop(NodeId condition, NodeId body, NodeId increment) {
+        std::vector<Type> start = copySlots();
+        for (;;) {
+            inferCondition(condition);
+            std::vector<Type> exit = copySlots();
+            inferStatement(body);
+            inferStatement(increment);
+            joinInto(slots, start);
+            if (slots == start) {
+                std::swap(slots, exit);
+                recycle(exit);
+                recycle(start);
+                return;
+            }
+            recycle(exit);
+            start.assign(slots.begin(), slots.end());
+        }
+    }
+
+    Type inferExpression(NodeId expr) {
+        uint32_t a = ast->a[expr];
+        uint32_t b = ast->b[expr];
+        switch (ast->kinds[expr]) {
+            case NodeKind::NumberExpression:
+                return (ast->flags[expr] & FlatAst::IS_DOUBLE) ? Type::Double : Type::Int;
+            case NodeKind::StringExpression:
+                return Type::String;
+            case NodeKind::BoolExpression:
+                return Type::Bool;
+            case NodeKind::VariableExpression:
+                if (ast->flags[expr] & FlatAst::IS_LOCAL) {
+                    return slots[b];
+                }
+                mayFail();
+                return Type::Any;
+            case NodeKind::BinaryExpression:
+                return inferBinary(expr);
+            case NodeKind::UnaryExpression:
+                return inferUnary(expr);
+            case NodeKind::IndexExpression:
+                inferExpression(a);
+                inferExpression(b);
+                break;
+            case NodeKind::ReadExpression:
+                if (a != NO_NODE) {
+                    inferExpression(a);
+                }
+                break;
+            case NodeKind::ArrayExpression:
+                for (uint32_t i = 0; i < b; ++i) {
+                    inferExpression(ast->children[a + i]);
+                }
+                break;
+            case NodeKind::FunctionCallExpression:
+                for (uint32_t i = 0, count = ast->c[expr]; i < count; ++i) {
+                    inferExpression(ast->children[b + i]);
+                }
+                break;
+            default:
+                break;
+        }
+        mayFail();
+        return Type::Any;
+    }
+
+    Type inferBinary(NodeId expr) {
+        Op op = ast->ops[expr];
+        NodeId target = ast->a[expr];
+        if (op == Op::Assign) {
+            Type type = inferExpression(ast->b[expr]);
+            if (ast->kinds[target] == NodeKind::IndexExpression) {
+                inferExpression(ast->b[target]);
+                mayFail();
+                if (ast->kinds[ast->a[target]] == NodeKind::VariableExpression) {
+                    assign(ast->a[target], Type::Any);
+                }
+                return type;
+            }
+            if (ast->kinds[target] != NodeKind::VariableExpression) {
+                mayFail();
+                return Type::Any;
+            }
+            assign(target, type);
+            return type;
+        }
+
+        Type left = inferExpression(target);
+        Type right = inferExpression(ast->b[expr]);
+        uint8_t known = 0;
+        if (op != Op::Power && left == right) {
+            known = left == Type::Int ? FlatAst::INT_OPERANDS : left == Type::Double ? FlatAst::DOUBLE_OPERANDS : 0;
+        }
+        ast->flags[expr] = static_cast<uint8_t>((ast->flags[expr] & ~(FlatAst::INT_OPERANDS | FlatAst::DOUBLE_OPERANDS)) | known);
+
+        bool numbers = isNumber(left) && isNumber(right);
+        Type arithmetic = left == Type::Int && right == Type::Int ? Type::Int : Type::Double;
+        switch (op) {
+            case Op::Add:
+                if (left == Type::String || right == Type::String) {
+                    return Type::String;
+                }
+                [[fallthrough]];
+            case Op::Subtract:
+            case Op::Multiply:
+                if (numbers) {
+                    return arithmetic;
+                }
+                break;
+            case Op::Divide:
+                mayFail(); // by zero
+                return numbers ? arithmetic : Type::Any;
+            case Op::Power:
+                if (numbers) {
+                    return arithmetic == Type::Int ? Type::Any : Type::Double; // a negative int exponent gives a double
+                }
+                break;
+            case Op::Less:
+            case Op::Greater:
+            case Op::LessEqual:
+            case Op::GreaterEqual:
+                if (!numbers && !(left == Type::String && right == Type::String)) {
+                    mayFail();
+                }
+                return Type::Bool;
+            case Op::Equal:
+            case Op::NotEqual:
+                return Type::Bool;
+            default:
+                break;
+        }
+        mayFail();
+        return Type::Any;
+    }
+
+    Type inferUnary(NodeId expr) {
+        Op op = ast->ops[expr];
+        NodeId operand = ast->a[expr];
+        if (op == Op::Subtract) {
+            Type type = inferExpression(operand);
+            if (isNumber(type)) {
+                return type;
+            }
+        } else if (op == Op::Not) {
+            if (inferExpression(operand) != Type::Bool) {
+                mayFail();
+            }
+            return Type::Bool;
+        } else if ((op == Op::Increment || op == Op::Decrement) && ast->kinds[operand] == NodeKind::VariableExpression &&
+                   (ast->flags[operand] & FlatAst::IS_LOCAL)) {
+            // A step keeps an int an int and a double a double; anything else fails unchanged.
+            Type type = slots[ast->b[operand]];
+            if (isNumber(type)) {
+                return type;
+            }
+            mayFail();
+            slots[ast->b[operand]] = Type::Any;
+            return Type::Any;
+        }
+        mayFail();
+        return Type::Any;
+    }
+};
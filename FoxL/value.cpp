@@ -0,0 +1,238 @@
+#include <cstdint>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// For the small functions the VM runs on every instruction. Its dispatch loop is large enough
+// that compilers stop inlining into it on their own, and a call costs as much as the work.
+#if defined(__GNUC__)
+#define FOXL_ALWAYS_INLINE __attribute__((always_inline))
+#elif defined(_MSC_VER)
+#define FOXL_ALWAYS_INLINE __forceinline
+#else
+#define FOXL_ALWAYS_INLINE
+#endif
+
+enum class ValueType : uint8_t {
+    Int,
+    Double,
+    Bool,
+    String,
+    IntArray,
+    StringArray
+};
+
+// Strings and arrays are shared between copies of a Value and freed with the last one.
+// Mutation goes through Value::mutable*(), which copies the object first if it is shared,
+// so FoxL keeps value semantics for arrays.
+struct HeapObject {
+    uint32_t refCount = 1;
+};
+
+struct StringObject : HeapObject {
+    std::string value;
+    explicit StringObject(std::string value) : value(std::move(value)) {}
+};
+
+struct IntArrayObject : HeapObject {
+    std::vector<int> values;
+    explicit IntArrayObject(std::vector<int> values) : values(std::move(values)) {}
+};
+
+struct StringArrayObject : HeapObject {
+    std::vector<std::string> values;
+    explicit StringArrayObject(std::vector<std::string> values) : values(std::move(values)) {}
+};
+
+// A 16-byte tagged value: int, double and bool are stored inline, so scalar
+// arithmetic never allocates; strings and arrays are refcounted heap objects.
+class Value {
+public:
+    Value() : tag(ValueType::Int), bits(0) {}
+    Value(int value) : tag(ValueType::Int), bits(0) { intValue = value; }
+    Value(double value) : tag(ValueType::Double), doubleValue(value) {}
+    Value(bool value) : tag(ValueType::Bool), bits(0) { boolValue = value; }
+    Value(const char* value) : Value(std::string(value)) {}
+    Value(std::string value) : tag(ValueType::String), object(new StringObject(std::move(value))) {}
+    Value(std::vector<int> values) : tag(ValueType::IntArray), object(new IntArrayObject(std::move(values))) {}
+    Value(std::vector<std::string> values) : tag(ValueType::StringArray), object(new StringArrayObject(std::move(values))) {}
+
+    FOXL_ALWAYS_INLINE Value(const Value& other) : tag(other.tag), bits(other.bits) {
+        retain();
+    }
+
+    Value(Value&& other) noexcept : tag(other.tag), bits(other.bits) {
+        other.tag = ValueType::Int;
+        other.bits = 0;
+    }
+
+    FOXL_ALWAYS_INLINE Value& operator=(const Value& other) {
+        if (this != &other) {
+            other.retain();
+            release();
+            tag = other.tag;
+            bits = other.bits;
+        }
+        return *this;
+    }
+
+    FOXL_ALWAYS_INLINE Value& operator=(Value&& other) noexcept {
+        if (this != &other) {
+            release();
+            tag = other.tag;
+            bits = other.bits;
+            other.tag = ValueType::Int;
+            other.bits = 0;
+        }
+        return *this;
+    }
+
+    FOXL_ALWAYS_INLINE ~Value() {
+        release();
+    }
+
+    ValueType type() const { return tag; }
+    bool isInt() const { return tag == ValueType::Int; }
+    bool isDouble() const { return tag == ValueType::Double; }
+    bool isNumber() const { return tag == ValueType::Int || tag == ValueType::Double; }
+    bool isBool() const { return tag == ValueType::Bool; }
+    bool isString() const { return tag == ValueType::String; }
+    bool isIntArray() const { return tag == ValueType::IntArray; }
+    bool isStringArray() const { return tag == ValueType::StringArray; }
+
+    int asInt() const { return intValue; }
+    double asDouble() const { return doubleValue; }
+    double asNumber() const { return tag == ValueType::Int ? intValue : doubleValue; }
+    bool asBool() const { return boolValue; }
+    const std::string& asString() const { return static_cast<const StringObject*>(object)->value; }
+    const std::vector<int>& asIntArray() const { return static_cast<const IntArrayObject*>(object)->values; }
+    const std::vector<std::string>& asStringArray() const { return static_cast<const StringArrayObject*>(object)->values; }
+
+    std::vector<int>& mutableIntArray() { return detach<IntArrayObject>()->values; }
+    std::vector<std::string>& mutableStringArray() { return detach<StringArrayObject>()->values; }
+
+    bool operator==(const Value& other) const {
+        if (tag != other.tag) {
+            return false;
+        }
+        switch (tag) {
+            case ValueType::Int: return intValue == other.intValue;
+            case ValueType::Double: return doubleValue == other.doubleValue;
+            case ValueType::Bool: return boolValue == other.boolValue;
+            case ValueType::String: return asString() == other.asString();
+            case ValueType::IntArray: return asIntArray() == other.asIntArray();
+            case ValueType::StringArray: return asStringArray() == other.asStringArray();
+        }
+        return false;
+    }
+
+    bool operator!=(const Value& other) const {
+        return !(*this == other);
+    }
+
+    friend std::ostream& operator<<(std::ostream& out, const Value& value) {
+        switch (value.tag) {
+            case ValueType::Int: return out << value.intValue;
+            case ValueType::Double: return out << value.doubleValue;
+            case ValueType::Bool: return out << value.boolValue;
+            case ValueType::String: return out << value.asString();
+            case ValueType::IntArray: return printArray(out, value.asIntArray());
+            case ValueType::StringArray: return printArray(out, value.asStringArray());
+        }
+        return out;
+    }
+
+    std::string toString() const {
+        if (tag == ValueType::String) {
+            return asString();
+        }
+        std::ostringstream out;
+        out << *this;
+        return out.str();
+    }
+
+private:
+    ValueType tag;
+    union {
+        int intValue;
+        double doubleValue;
+        bool boolValue;
+        HeapObject* object;
+        uint64_t bits;
+    };
+
+    bool isHeap() const {
+        return tag == ValueType::String || tag == ValueType::IntArray || tag == ValueType::StringArray;
+    }
+
+    FOXL_ALWAYS_INLINE void retain() const {
+        if (isHeap()) {
+            ++object->refCount;
+        }
+    }
+
+    // The check is inlined wherever a Value is overwritten or destroyed; freeing is not.
+    FOXL_ALWAYS_INLINE void release() {
+        if (isHeap() && --object->refCount == 0) {
+            destroy();
+        }
+    }
+
+    void destroy() {
+        switch (tag) {
+            case ValueType::String: delete static_cast<StringObject*>(object); break;
+            case ValueType::IntArray: delete static_cast<IntArrayObject*>(object); break;
+            case ValueType::StringArray: delete static_cast<StringArrayObject*>(object); break;
+            default: break;
+        }
+    }
+
+    template <typename T>
+    T* detach() {
+        auto* current = static_cast<T*>(object);
+        if (current->refCount > 1) {
+            --current->refCount;
+            current = new T(*current);
+            current->refCount = 1;
+            object = current;
+        }
+        return current;
+    }
+
+    template <typename T>
+    static std::ostream& printArray(std::ostream& out, const std::vector<T>& values) {
+        out << "[";
+        for (size_t i = 0; i < values.size(); ++i) {
+            out << values[i];
+            if (i < values.size() - 1) {
+                out << ", ";
+            }
+        }
+        return out << "]";
+    }
+};
+
+// The arithmetic operators of both engines. Int results wrap around on overflow, as in two's
+// complement, so that no int operation is undefined; doubles follow IEEE. Division by zero is
+// checked by the callers, which report it.
+struct Arithmetic {
+    static int add(int a, int b) { return static_cast<int>(static_cast<uint32_t>(a) + static_cast<uint32_t>(b)); }
+    static int subtract(int a, int b) { return static_cast<int>(static_cast<uint32_t>(a) - static_cast<uint32_t>(b)); }
+    static int multiply(int a, int b) { return static_cast<int>(static_cast<uint32_t>(a) * static_cast<uint32_t>(b)); }
+    static int negate(int a) { return subtract(0, a); }
+
+    static int divide(int a, int b) {
+        if (b == -1) {
+            return negate(a); // INT_MIN / -1 overflows, and traps on most CPUs
+        }
+        return a / b;
+    }
+
+    static double add(double a, double b) { return a + b; }
+    static double subtract(double a, double b) { return a - b; }
+    static double multiply(double a, double b) { return a * b; }
+    static double negate(double a) { return -a; }
+    static double divide(double a, double b) { return a / b; }
+};
@@ -0,0 +1,636 @@
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class VM {
+public:
+    explicit VM(Interpreter& interpreter) : interpreter(interpreter) {
+        stack.reserve(256);
+    }
+
+    // Returns false when the script ended at a `return` instead of running to its end.
+    bool run(std::unique_ptr<Program> program) {
+        LoadedProgram* loaded = load(std::move(program));
+        size_t baseDepth = frames.size();
+        pushFrame(&loaded->program->script, loaded, stack.size());
+        execute(baseDepth);
+        stack.pop_back(); // script result
+        const std::vector<uint8_t>& code = loaded->program->script.chunk.code;
+        return exitIp == code.data() + code.size();
+    }
+
+    // Runs a script as it is read: each top-level statement is compiled to a program of its
+    // own and run before the next one is parsed past its first token, the same way included
+    // files share functions and globals by name. Programs that declared no functions are
+    // dropped once they have run.
+    void runStream(Lexer& lexer) {
+        FlatAst tree;
+        const FlatAst::Mark empty = tree.mark();
+        StatementReader reader(lexer, tree);
+        NodeId statement;
+        while ((statement = reader.next()) != NO_NODE) {
+            std::unique_ptr<Program> program = Compiler().compile(tree, { statement });
+            tree.truncate(empty); // the program has copies of its strings
+            bool declaresFunctions = !program->functions.empty();
+            size_t index = programs.size();
+            bool finished = run(std::move(program));
+            if (!declaresFunctions) {
+                programs.erase(programs.begin() + index); // any included after it stay
+            }
+            if (!finished) {
+                break; // a top-level return ends the script
+            }
+        }
+    }
+
+private:
+    struct LoadedProgram;
+
+    struct FunctionEntry {
+        const FunctionProto* function = nullptr;
+        LoadedProgram* program = nullptr;
+        uint64_t generation = 0;
+    };
+
+    // Runtime state for one compiled program: name indices resolve lazily to stable
+    // pointers into Interpreter::variables and to the currently defined functions.
+    struct LoadedProgram {
+        std::unique_ptr<Program> program;
+        std::unique_ptr<ParsedFile> file; // for included files, the tree lazy functions of `program` point into
+        std::vector<Interpreter::Variable*> globals;
+        std::vector<FunctionEntry> functionCache;
+    };
+
+    // A frame's local slots live on the value stack starting at `slots`;
+    // its temporaries start at `stackBase`, right after the last slot.
+    struct CallFrame {
+        const FunctionProto* function;
+        LoadedProgram* program;
+        const uint8_t* ip;
+        size_t slots;
+        size_t stackBase;
+    };
+
+    Interpreter& interpreter;
+    std::vector<Value> stack;
+    std::vector<CallFrame> frames;
+    std::vector<std::unique_ptr<LoadedProgram>> programs;
+    std::unordered_map<SymbolId, FunctionEntry> functions;
+    uint64_t functionGeneration = 1;
+    const uint8_t* exitIp = nullptr; // just past the Return the last finished script left by
+
+    LoadedProgram* load(std::unique_ptr<Program> program) {
+        auto loaded = std::make_unique<LoadedProgram>();
+        loaded->globals.assign(program->names.size(), nullptr);
+        loaded->functionCache.assign(program->names.size(), FunctionEntry{});
+        loaded->program = std::move(program);
+        programs.push_back(std::move(loaded));
+        return programs.back().get();
+    }
+
+    void execute(size_t baseDepth) {
+        for (;;) {
+            try {
+                dispatch(baseDepth);
+                return;
+            } catch (const std::exception& e) {
+                if (!recover(e, baseDepth)) {
+                    throw;
+                }
+            }
+        }
+    }
+
+    // Report the error against the innermost statement that contains the faulting
+    // instruction and resume after it, unwinding frames that have no such statement.
+    bool recover(const std::exception& e, size_t baseDepth) {
+        while (frames.size() > baseDepth) {
+            CallFrame& frame = frames.back();
+            const Chunk& chunk = frame.function->chunk;
+            uint32_t offset = static_cast<uint32_t>(frame.ip - chunk.code.data() - 1);
+            for (const auto& range : chunk.statements) {
+                if (range.start <= offset && offset < range.end) {
+                    std::cerr << "Error executing statement: " << e.what() << std::endl;
+                    frame.ip = chunk.code.data() + range.end;
+                    stack.resize(frame.stackBase);
+                    return true;
+                }
+            }
+            popFrame();
+        }
+        return false;
+    }
+
+    // The first `slots` entries already on the stack (the arguments) become the
+    // frame's leading slots; the remaining slots are zero-initialised.
+    void pushFrame(const FunctionProto* function, LoadedProgram* program, size_t slots) {
+        stack.resize(slots + function->slotCount);
+        frames.push_back({ function, program, function->chunk.code.data(), slots, stack.size() });
+    }
+
+    void popFrame() {
+        stack.resize(frames.back().slots);
+        frames.pop_back();
+    }
+
+    // Small enough to inline into dispatch(); the first lookup of each name goes out of line.
+    FOXL_ALWAYS_INLINE Interpreter::Variable* global(LoadedProgram* loaded, uint16_t name) {
+        Interpreter::Variable* slot = loaded->globals[name];
+        return slot ? slot : findGlobal(loaded, name);
+    }
+
+    Interpreter::Variable* findGlobal(LoadedProgram* loaded, uint16_t name) {
+        auto it = interpreter.variables.find(loaded->program->names[name]);
+        if (it == interpreter.variables.end()) {
+            throw std::runtime_error("Undefined variable: " + Symbols::name(loaded->program->names[name]));
+        }
+        loaded->globals[name] = &it->second;
+        return &it->second;
+    }
+
+    // Returns nullptr when no user-defined function has this name, leaving it to the builtins.
+    const FunctionEntry* resolveFunction(LoadedProgram* loaded, uint16_t name) {
+        FunctionEntry& entry = loaded->functionCache[name];
+        if (entry.generation != functionGeneration) {
+            auto it = functions.find(loaded->program->names[name]);
+            if (it == functions.end()) {
+                return nullptr;
+            }
+            entry = it->second;
+            entry.generation = functionGeneration;
+        }
+        return &entry;
+    }
+
+    // Compiles a body the parser skipped in lazy mode, right before its first call. The
+    // function may have added names to its program, so the per-name caches grow to match;
+    // this invalidates FunctionEntry pointers into them.
+    void compileLazyFunction(LoadedProgram* loaded, const FunctionProto* function) {
+        Compiler compiler;
+        compiler.compileLazyFunction(*loaded->program, const_cast<FunctionProto&>(*function));
+        loaded->globals.resize(loaded->program->names.size(), nullptr);
+        loaded->functionCache.resize(loaded->program->names.size(), FunctionEntry{});
+    }
+
+    std::unique_ptr<Program> compileInclude(ParsedFile& module) {
+        try {
+            Compiler compiler;
+            return compiler.compile(module.ast, module.statements);
+        } catch (const std::exception& e) {
+            throw std::runtime_error("Error in included file: " + std::string(e.what()));
+        }
+    }
+
+    template <typename IntOperation>
+    FOXL_ALWAYS_INLINE void binaryOp(IntOperation intOperation,
+                                     Value (Interpreter::*handler)(
+                                         const Value&,
+                                         const Value&)) {
+        auto& right = stack.back();
+        auto& left = stack[stack.size() - 2];
+        if (left.isInt() && right.isInt()) {
+            left = intOperation(left.asInt(), right.asInt());
+        } else {
+            left = (interpreter.*handler)(left, right);
+        }
+        stack.pop_back();
+    }
+
+    // For the instructions whose operands the compiler knows to be two ints or two doubles.
+    template <typename Operation>
+    FOXL_ALWAYS_INLINE void intOp(Operation operation) {
+        auto& right = stack.back();
+        auto& left = stack[stack.size() - 2];
+        left = operation(left.asInt(), right.asInt());
+        stack.pop_back();
+    }
+
+    template <typename Operation>
+    FOXL_ALWAYS_INLINE void doubleOp(Operation operation) {
+        auto& right = stack.back();
+        auto& left = stack[stack.size() - 2];
+        left = operation(left.asDouble(), right.asDouble());
+        stack.pop_back();
+    }
+
+    // The errors dispatch() can raise, kept out of it so that its hot paths stay small enough
+    // for the compiler to inline what they call.
+    [[noreturn]] static void constantError(SymbolId name) {
+        throw std::runtime_error("Cannot reassign constant variable: " + Symbols::name(name));
+    }
+
+    [[noreturn]] static void divisionByZero() {
+        throw std::runtime_error("Division by zero");
+    }
+
+    [[noreturn]] static void argumentCountError(const FunctionProto* function, int line) {
+        throw std::runtime_error("Function " + Symbols::name(function->name) + " expects " + std::to_string(function->parameters.size()) +
+                                 " arguments at line " + std::to_string(line));
+    }
+
+    [[noreturn]] static void fail(const std::string& message) {
+        throw std::runtime_error(message);
+    }
+
+    [[noreturn]] static void invalidOpcode(uint8_t opcode) {
+        throw std::runtime_error("Invalid opcode " + std::to_string(opcode));
+    }
+
+    // Pops two operands and compares them, as the instruction whose handler is given would.
+    template <typename IntComparison>
+    FOXL_ALWAYS_INLINE bool compare(IntComparison intComparison, Value (Interpreter::*handler)(const Value&, const Value&)) {
+        const Value& right = stack.back();
+        const Value& left = stack[stack.size() - 2];
+        bool result = left.isInt() && right.isInt() ? intComparison(left.asInt(), right.asInt())
+                                                    : (interpreter.*handler)(left, right).asBool();
+        stack.pop_back();
+        stack.pop_back();
+        return result;
+    }
+
+    FOXL_ALWAYS_INLINE static uint16_t readShort(const uint8_t*& ip) {
+        ip += 2;
+        return static_cast<uint16_t>(ip[-2] | (ip[-1] << 8));
+    }
+
+    void dispatch(size_t baseDepth) {
+        CallFrame* frame = &frames.back();
+        const uint8_t* ip = frame->ip;
+
+        // Takes copies, so that ip can stay in a register.
+        auto currentLine = [](const CallFrame* frame, const uint8_t* ip) {
+            const Chunk& chunk = frame->function->chunk;
+            return chunk.lines[ip - chunk.code.data() - 1];
+        };
+
+        try {
+            for (;;) {
+                switch (static_cast<OpCode>(*ip++)) {
+                    case OpCode::Constant:
+                        stack.push_back(frame->function->chunk.constants[readShort(ip)]);
+                        break;
+                    case OpCode::Pop:
+                        stack.pop_back();
+                        break;
+                    case OpCode::DefineGlobal: {
+                        uint16_t name = readShort(ip);
+                        bool isConstant = *ip++ != 0;
+                        SymbolId varName = frame->program->program->names[name];
+                        auto it = interpreter.variables.find(varName);
+                        if (it != interpreter.variables.end() && it->second.isConstant) {
+                            constantError(varName);
+                        }
+                        Interpreter::Variable& variable = interpreter.variables[varName];
+                        variable = { std::move(stack.back()), isConstant };
+                        stack.pop_back();
+                        frame->program->globals[name] = &variable;
+                        interpreter.persistVariable(varName);
+                        break;
+                    }
+                    case OpCode::GetGlobal:
+                        stack.push_back(global(frame->program, readShort(ip))->value);
+                        break;
+                    case OpCode::SetGlobal: {
+                        uint16_t name = readShort(ip);
+                        Interpreter::Variable* variable = global(frame->program, name);
+                        if (variable->isConstant) {
+                            constantError(frame->program->program->names[name]);
+                        }
+                        variable->value = stack.back();
+                        break;
+                    }
+                    case OpCode::GetLocal:
+                        stack.push_back(stack[frame->slots + readShort(ip)]);
+                        break;
+                    case OpCode::SetLocal:
+                        stack[frame->slots + readShort(ip)] = stack.back();
+                        break;
+                    case OpCode::GetIndex: {
+                        auto index = std::move(stack.back());
+                        stack.pop_back();
+                        stack.back() = interpreter.indexValue(stack.back(), index, currentLine(frame, ip));
+                        break;
+                    }
+                    case OpCode::SetIndex: {
+                        uint16_t name = readShort(ip);
+                        auto index = std::move(stack.back());
+                        stack.pop_back();
+                        Interpreter::Variable* variable = global(frame->program, name);
+                        if (variable->isConstant) {
+                            constantError(frame->program->program->names[name]);
+                        }
+                        interpreter.storeIndex(variable->value, index, stack.back(), currentLine(frame, ip));
+                        break;
+                    }
+                    case OpCode::SetIndexLocal: {
+                        uint16_t slot = readShort(ip);
+                        auto index = std::move(stack.back());
+                        stack.pop_back();
+                        interpreter.storeIndex(stack[frame->slots + slot], index, stack.back(), currentLine(frame, ip));
+                        break;
+                    }
+                    case OpCode::Increment:
+                    case OpCode::Decrement: {
+                        int delta = static_cast<OpCode>(ip[-1]) == OpCode::Increment ? 1 : -1;
+                        uint16_t name = readShort(ip);
+                        Interpreter::Variable* variable = global(frame->program, name);
+                        if (variable->isConstant) {
+                            constantError(frame->program->program->names[name]);
+                        }
+                        stack.push_back(interpreter.stepValue(variable->value, frame->program->program->names[name], delta));
+                        break;
+                    }
+                    case OpCode::IncrementLocal:
+                    case OpCode::DecrementLocal: {
+                        int delta = static_cast<OpCode>(ip[-1]) == OpCode::IncrementLocal ? 1 : -1;
+                        uint16_t slot = readShort(ip);
+                        uint16_t name = readShort(ip);
+                        auto previous = interpreter.stepValue(stack[frame->slots + slot], frame->program->program->names[name], delta);
+                        stack.push_back(std::move(previous));
+                        break;
+                    }
+                    case OpCode::Add:
+                        binaryOp([](int a, int b) { return Arithmetic::add(a, b); }, &Interpreter::handleAddition);
+                        break;
+                    case OpCode::Subtract:
+                        binaryOp([](int a, int b) { return Arithmetic::subtract(a, b); }, &Interpreter::handleSubtraction);
+                        break;
+                    case OpCode::Multiply:
+                        binaryOp([](int a, int b) { return Arithmetic::multiply(a, b); }, &Interpreter::handleMultiplication);
+                        break;
+                    case OpCode::Divide:
+                        binaryOp([](int a, int b) {
+                            if (b == 0) {
+                                divisionByZero();
+                            }
+                            return Arithmetic::divide(a, b);
+                        }, &Interpreter::handleDivision);
+                        break;
+                    case OpCode::Power: {
+                        Value right = std::move(stack.back());
+                        stack.pop_back();
+                        stack.back() = interpreter.handlePower(stack.back(), right);
+                        break;
+                    }
+                    case OpCode::Negate:
+                        stack.back() = stack.back().isInt() ? Value(Arithmetic::negate(stack.back().asInt())) : interpreter.handleNegate(stack.back());
+                        break;
+                    case OpCode::Not:
+                        stack.back() = interpreter.handleNot(stack.back());
+                        break;
+                    case OpCode::Less:
+                        binaryOp([](int a, int b) { return a < b; }, &Interpreter::handleLessThan);
+                        break;
+                    case OpCode::Greater:
+                        binaryOp([](int a, int b) { return a > b; }, &Interpreter::handleGreaterThan);
+                        break;
+                    case OpCode::LessEqual:
+                        binaryOp([](int a, int b) { return a <= b; }, &Interpreter::handleLessThanOrEqual);
+                        break;
+                    case OpCode::GreaterEqual:
+                        binaryOp([](int a, int b) { return a >= b; }, &Interpreter::handleGreaterThanOrEqual);
+                        break;
+                    case OpCode::Equal:
+                        binaryOp([](int a, int b) { return a == b; }, &Interpreter::handleEqual);
+                        break;
+                    case OpCode::NotEqual:
+                        binaryOp([](int a, int b) { return a != b; }, &Interpreter::handleNotEqual);
+                        break;
+                    case OpCode::AddInt:
+                        intOp([](int a, int b) { return Arithmetic::add(a, b); });
+                        break;
+                    case OpCode::SubtractInt:
+                        intOp([](int a, int b) { return Arithmetic::subtract(a, b); });
+                        break;
+                    case OpCode::MultiplyInt:
+                        intOp([](int a, int b) { return Arithmetic::multiply(a, b); });
+                        break;
+                    case OpCode::DivideInt:
+                        intOp([](int a, int b) {
+                            if (b == 0) {
+                                divisionByZero();
+                            }
+                            return Arithmetic::divide(a, b);
+                        });
+                        break;
+                    case OpCode::LessInt:
+                        intOp([](int a, int b) { return a < b; });
+                        break;
+                    case OpCode::GreaterInt:
+                        intOp([](int a, int b) { return a > b; });
+                        break;
+                    case OpCode::LessEqualInt:
+                        intOp([](int a, int b) { return a <= b; });
+                        break;
+                    case OpCode::GreaterEqualInt:
+                        intOp([](int a, int b) { return a >= b; });
+                        break;
+                    case OpCode::EqualInt:
+                        intOp([](int a, int b) { return a == b; });
+                        break;
+                    case OpCode::NotEqualInt:
+                        intOp([](int a, int b) { return a != b; });
+                        break;
+                    case OpCode::AddDouble:
+                        doubleOp([](double a, double b) { return a + b; });
+                        break;
+                    case OpCode::SubtractDouble:
+                        doubleOp([](double a, double b) { return a - b; });
+                        break;
+                    case OpCode::MultiplyDouble:
+                        doubleOp([](double a, double b) { return a * b; });
+                        break;
+                    case OpCode::DivideDouble:
+                        doubleOp([](double a, double b) {
+                            if (b == 0) {
+                                divisionByZero();
+                            }
+                            return Arithmetic::divide(a, b);
+                        });
+                        break;
+                    case OpCode::LessDouble:
+                        doubleOp([](double a, double b) { return a < b; });
+                        break;
+                    case OpCode::GreaterDouble:
+                        doubleOp([](double a, double b) { return a > b; });
+                        break;
+                    case OpCode::LessEqualDouble:
+                        doubleOp([](double a, double b) { return a <= b; });
+                        break;
+                    case OpCode::GreaterEqualDouble:
+                        doubleOp([](double a, double b) { return a >= b; });
+                        break;
+                    case OpCode::EqualDouble:
+                        doubleOp([](double a, double b) { return a == b; });
+                        break;
+                    case OpCode::NotEqualDouble:
+                        doubleOp([](double a, double b) { return a != b; });
+                        break;
+                    case OpCode::Array: {
+                        uint16_t count = readShort(ip);
+                        std::vector<Value> elements(
+                            std::make_move_iterator(stack.end() - count), std::make_move_iterator(stack.end()));
+                        stack.resize(stack.size() - count);
+                        stack.push_back(interpreter.makeArray(std::move(elements), currentLine(frame, ip)));
+                        break;
+                    }
+                    case OpCode::Read: {
+                        bool hasPrompt = *ip++ != 0;
+                        if (hasPrompt) {
+                            stack.back() = interpreter.readValue(stack.back());
+                        } else {
+                            stack.push_back(interpreter.readValue(std::nullopt));
+                        }
+                        break;
+                    }
+                    case OpCode::Write:
+                        Interpreter::printValue(stack.back());
+                        stack.pop_back();
+                        break;
+                    case OpCode::Jump: {
+                        uint16_t offset = readShort(ip);
+                        ip += offset;
+                        break;
+                    }
+                    case OpCode::JumpIfFalse: {
+                        uint16_t offset = readShort(ip);
+                        bool condition = Interpreter::isTrue(stack.back());
+                        stack.pop_back();
+                        if (!condition) {
+                            ip += offset;
+                        }
+                        break;
+                    }
+                    case OpCode::Loop: {
+                        uint16_t offset = readShort(ip);
+                        ip -= offset;
+                        break;
+                    }
+                    case OpCode::DefineFunction: {
+                        const FunctionProto* function = frame->program->program->functions[readShort(ip)].get();
+                        functions[function->name] = { function, frame->program, 0 };
+                        ++functionGeneration;
+                        break;
+                    }
+                    case OpCode::Call: {
+                        uint16_t name = readShort(ip);
+                        uint8_t argCount = *ip++;
+                        const FunctionEntry* entry = resolveFunction(frame->program, name);
+                        if (!entry) {
+                            std::vector<Value> arguments(std::make_move_iterator(stack.end() - argCount),
+                                                         std::make_move_iterator(stack.end()));
+                            stack.resize(stack.size() - argCount);
+                            stack.push_back(interpreter.callBuiltin(frame->program->program->names[name], arguments, currentLine(frame, ip)));
+                            break;
+                        }
+                        const FunctionProto* function = entry->function;
+                        if (function->parameters.size() != argCount) {
+                            argumentCountError(function, currentLine(frame, ip));
+                        }
+                        LoadedProgram* program = entry->program;
+                        frame->ip = ip;
+                        if (function->lazyAst) {
+                            compileLazyFunction(program, function);
+                        }
+                        pushFrame(function, program, stack.size() - argCount);
+                        frame = &frames.back();
+                        ip = frame->ip;
+                        break;
+                    }
+                    case OpCode::Return: {
+                        auto result = std::move(stack.back());
+                        stack.pop_back();
+                        popFrame();
+                        stack.push_back(std::move(result));
+                        if (frames.size() == baseDepth) {
+                            exitIp = ip;
+                            return;
+                        }
+                        frame = &frames.back();
+                        ip = frame->ip;
+                        break;
+                    }
+                    case OpCode::Include: {
+                        const std::string& fileName = frame->function->chunk.constants[readShort(ip)].asString();
+                        frame->ip = ip;
+                        std::optional<ParsedFile> module = interpreter.modules.include(fileName);
+                        if (!module) {
+                            stack.push_back(0); // already loaded; stands in for the script result
+                            break;
+                        }
+                        auto file = std::make_unique<ParsedFile>(std::move(*module));
+                        LoadedProgram* loaded = load(compileInclude(*file));
+                        loaded->file = std::move(file);
+
+                        pushFrame(&loaded->program->script, loaded, stack.size());
+                        frame = &frames.back();
+                        ip = frame->ip;
+                        break;
+                    }
+                    case OpCode::Fail:
+                        fail(frame->function->chunk.constants[readShort(ip)].asString());
+                    case OpCode::AddLocalConstant: {
+                        Value& local = stack[frame->slots + readShort(ip)];
+                        const Value& constant = frame->function->chunk.constants[readShort(ip)];
+                        if (local.isInt() && constant.isInt()) {
+                            local = Arithmetic::add(local.asInt(), constant.asInt());
+                        } else {
+                            local = interpreter.handleAddition(local, constant);
+                        }
+                        break;
+                    }
+                    case OpCode::StepLocal: {
+                        Value& local = stack[frame->slots + readShort(ip)];
+                        uint16_t name = readShort(ip);
+                        int delta = *ip++ ? 1 : -1;
+                        if (local.isInt()) {
+                            local = Arithmetic::add(local.asInt(), delta);
+                        } else {
+                            interpreter.stepValue(local, frame->program->program->names[name], delta);
+                        }
+                        break;
+                    }
+                    case OpCode::JumpIfNotLess: {
+                        uint16_t offset = readShort(ip);
+                        if (!compare([](int a, int b) { return a < b; }, &Interpreter::handleLessThan)) {
+                            ip += offset;
+                        }
+                        break;
+                    }
+                    case OpCode::JumpIfNotGreater: {
+                        uint16_t offset = readShort(ip);
+                        if (!compare([](int a, int b) { return a > b; }, &Interpreter::handleGreaterThan)) {
+                            ip += offset;
+                        }
+                        break;
+                    }
+                    case OpCode::JumpIfNotLessEqual: {
+                        uint16_t offset = readShort(ip);
+                        if (!compare([](int a, int b) { return a <= b; }, &Interpreter::handleLessThanOrEqual)) {
+                            ip += offset;
+                        }
+                        break;
+                    }
+                    case OpCode::JumpIfNotGreaterEqual: {
+                        uint16_t offset = readShort(ip);
+                        if (!compare([](int a, int b) { return a >= b; }, &Interpreter::handleGreaterThanOrEqual)) {
+                            ip += offset;
+                        }
+                        break;
+                    }
+                    default:
+                        invalidOpcode(ip[-1]);
+                }
+            }
+        } catch (...) {
+            frame->ip = ip;
+            throw;
+        }
+    }
+};
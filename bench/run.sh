@@ -0,0 +1,37 @@
+#!/bin/bash
+# Times every script in this directory with one or more foxl binaries, for comparing builds.
+# Prints the best of $RUNS runs (default 5) in seconds, on the engine given by $ENGINE
+# (default vm).
+# Usage: bench/run.sh <path to foxl> [<path to another foxl> ...]
+runs=${RUNS:-5}
+engine=${ENGINE:-vm}
+here=$(cd "$(dirname "$0")" && pwd)
+binaries=()
+for binary in "$@"; do
+    binaries+=("$(cd "$(dirname "$binary")" && pwd)/$(basename "$binary")")
+done
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+TIMEFORMAT=%R
+
+printf '%-12s' script
+for binary in "$@"; do
+    printf '  %10s' "$(basename "$binary")"
+done
+echo
+for script in "$here"/*.foxl; do
+    name=$(basename "$script")
+    cp "$script" "$work/$name" # so that caches and saved variables land there
+    printf '%-12s' "${name%.foxl}"
+    for binary in "${binaries[@]}"; do
+        best=
+        for ((run = 0; run < runs; ++run)); do
+            seconds=$( { time (cd "$work" && "$binary" --engine="$engine" "$name" > /dev/null 2>&1); } 2>&1 )
+            if [ -z "$best" ] || awk -v a="$seconds" -v b="$best" 'BEGIN { exit !(a < b) }'; then
+                best=$seconds
+            fi
+        done
+        printf '  %10s' "$best"
+    done
+    echo
+done
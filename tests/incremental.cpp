@@ -0,0 +1,155 @@
+// Checks IncrementalParser::update() against a fresh parse of the same text, for small edits at
+// every offset of a script: at statement starts, inside statements and just after them. Built
+// and run by run.sh.
+#include "../FoxL/mappedfile.cpp"
+#include "../FoxL/inputstream.cpp"
+#include "../FoxL/symbols.cpp"
+#include "../FoxL/scan.cpp"
+#include "../FoxL/lexer.cpp"
+#include "../FoxL/arena.cpp"
+#include "../FoxL/parser.cpp"
+#include "../FoxL/flatast.cpp"
+#include "../FoxL/compilecache.cpp"
+#include "../FoxL/incremental.cpp"
+#include <iostream>
+#include <string>
+#include <vector>
+
+// A node and everything under it as text, with its line, so that trees built in different
+// orders compare equal when they describe the same program.
+static std::string describe(const FlatAst& tree, NodeId id) {
+    if (id == NO_NODE) {
+        return "-";
+    }
+    uint32_t a = tree.a[id], b = tree.b[id], c = tree.c[id];
+    std::string text = "(" + std::to_string(static_cast<int>(tree.kinds[id])) + "@" + std::to_string(tree.lines[id]) + " op" +
+                       std::to_string(static_cast<int>(tree.ops[id])) + " f" + std::to_string(tree.flags[id]);
+    auto list = [&](uint32_t first, uint32_t count) {
+        for (uint32_t i = 0; i < count; ++i) {
+            text += " " + describe(tree, tree.children[first + i]);
+        }
+    };
+    switch (tree.kinds[id]) {
+        case NodeKind::WriteStatement:
+        case NodeKind::ExpressionStatement:
+        case NodeKind::ReturnStatement:
+        case NodeKind::ReadExpression:
+        case NodeKind::UnaryExpression:
+            text += " " + describe(tree, a);
+            break;
+        case NodeKind::VariableDeclaration:
+            text += " " + Symbols::name(a) + " " + describe(tree, b);
+            break;
+        case NodeKind::IfStatement:
+            text += " " + describe(tree, a) + " " + describe(tree, b) + " " + describe(tree, c);
+            break;
+        case NodeKind::ForStatement:
+            list(a, 4);
+            break;
+        case NodeKind::WhileStatement:
+        case NodeKind::BinaryExpression:
+        case NodeKind::IndexExpression:
+            text += " " + describe(tree, a) + " " + describe(tree, b);
+            break;
+        case NodeKind::BlockStatement:
+        case NodeKind::ArrayExpression:
+            list(a, b);
+            break;
+        case NodeKind::IncludeStatement:
+        case NodeKind::StringExpression:
+        case NodeKind::VariableExpression:
+            text += " '" + Symbols::name(a) + "'";
+            break;
+        case NodeKind::FunctionDeclaration: {
+            const FlatAst::Function& function = tree.functions[a];
+            text += " " + Symbols::name(function.name) + "@" + std::to_string(function.line);
+            for (uint32_t i = 0; i < function.parameterCount; ++i) {
+                text += " " + Symbols::name(tree.parameterNames[function.parameters + i]);
+            }
+            list(function.body, function.bodyCount);
+            break;
+        }
+        case NodeKind::FunctionCallExpression:
+            text += " " + Symbols::name(a);
+            list(b, c);
+            break;
+        default:
+            text += " " + std::to_string(a) + " " + std::to_string(b);
+            break;
+    }
+    return text + ")";
+}
+
+static std::string describe(const FlatAst& tree, const std::vector<NodeId>& statements) {
+    std::string text;
+    for (NodeId statement : statements) {
+        text += describe(tree, statement) + "\n";
+    }
+    return text;
+}
+
+// The statements of `source` parsed from scratch, or false if it does not parse.
+static bool parseFresh(const std::string& source, std::string& description) {
+    try {
+        FlatAst tree;
+        std::vector<NodeId> statements;
+        Lexer lexer(source);
+        StatementReader reader(lexer, tree);
+        for (NodeId statement; (statement = reader.next()) != NO_NODE;) {
+            statements.push_back(statement);
+        }
+        description = describe(tree, statements);
+        return true;
+    } catch (const std::exception&) {
+        return false;
+    }
+}
+
+int main() {
+    const std::string script =
+        "let a = 1;\n"
+        "if (a > 0) { write(\"yes\"); }\n"
+        "elsewrite(2);\n"
+        "func add(x, y) {\n"
+        "    return x + y;\n"
+        "}\n"
+        "// a comment\n"
+        "write(add(a, 2));\n"
+        "while (a < 3) { a++; }\n";
+    const std::vector<std::string> insertions = { " ", "\n", "x", ";", "else ", "write(3);\n", "}" };
+
+    int checked = 0, failures = 0;
+    auto check = [&](const std::string& before, size_t offset, size_t removed, const std::string& inserted) {
+        std::string after = before;
+        after.replace(offset, removed, inserted);
+        std::string expected, actual;
+        bool parses = parseFresh(after, expected);
+        IncrementalParser parser(before);
+        bool updated = true;
+        try {
+            parser.update(after);
+        } catch (const std::exception&) {
+            updated = false;
+        }
+        if (updated) {
+            actual = describe(parser.ast(), parser.statements());
+        }
+        ++checked;
+        if (updated != parses || (parses && actual != expected)) {
+            ++failures;
+            std::cout << "FAILED: at " << offset << ", replacing " << removed << " bytes with '" << inserted << "'\n"
+                      << (parses ? expected : "(does not parse)\n") << "but update() gave\n" << (updated ? actual : "(an error)\n");
+        }
+    };
+    for (size_t offset = 0; offset <= script.size(); ++offset) {
+        for (const std::string& inserted : insertions) {
+            check(script, offset, 0, inserted);
+        }
+        if (offset < script.size()) {
+            check(script, offset, 1, "");
+            check(script, offset, 1, "y");
+        }
+    }
+    std::cout << "incremental: " << checked << " edits, " << failures << " failed" << std::endl;
+    return failures == 0 ? 0 : 1;
+}
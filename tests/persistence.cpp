@@ -0,0 +1,69 @@
+// Checks that sync() leaves every declared variable in the data file under each --persist
+// policy, however recently the last batch was written. Built and run by run.sh.
+#include "../FoxL/mappedfile.cpp"
+#include "../FoxL/inputstream.cpp"
+#include "../FoxL/symbols.cpp"
+#include "../FoxL/scan.cpp"
+#include "../FoxL/lexer.cpp"
+#include "../FoxL/arena.cpp"
+#include "../FoxL/parser.cpp"
+#include "../FoxL/flatast.cpp"
+#include "../FoxL/compilecache.cpp"
+#include "../FoxL/incremental.cpp"
+#include "../FoxL/modules.cpp"
+#include "../FoxL/typeinference.cpp"
+#include "../FoxL/resolver.cpp"
+#include "../FoxL/value.cpp"
+#include "../FoxL/persistence.cpp"
+#include "../FoxL/interpreter.cpp"
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <string>
+
+static ParsedFile parse(const std::string& source) {
+    ParsedFile parsed;
+    Lexer lexer(source);
+    StatementReader reader(lexer, parsed.ast);
+    for (NodeId statement; (statement = reader.next()) != NO_NODE;) {
+        parsed.statements.push_back(statement);
+    }
+    return parsed;
+}
+
+// The last value written for each name, printed.
+static std::map<std::string, std::string> readDataFile(const std::string& fileName) {
+    std::map<std::string, std::string> values;
+    MappedFile file(fileName);
+    if (file.isOpen()) {
+        Snapshot::read(file.data(), file.size(), [&](const std::string& name, Value value, bool) {
+            values[name] = value.toString();
+        });
+    }
+    return values;
+}
+
+int main() {
+    std::string directory = (std::filesystem::temp_directory_path() / ("foxl-persistence-" + std::to_string(std::random_device{}()))).string();
+    std::filesystem::create_directories(directory);
+    std::string script = directory + "/script.foxl";
+    std::string dataFile = directory + "/script.FoxLData.foxl";
+
+    int failures = 0;
+    for (const char* policy : { "interval:100", "interval:3600000", "count:1", "count:1000", "exit" }) {
+        std::filesystem::remove(dataFile);
+        Interpreter interpreter(script, PersistPolicy::parse(policy));
+        interpreter.interpret(parse("let kept = 42;\n"
+                                    "let name = \"fox\";\n"
+                                    "sync();\n"));
+        std::map<std::string, std::string> values = readDataFile(dataFile);
+        if (values["kept"] != "42" || values["name"] != "fox") {
+            std::cout << "FAILED: with --persist=" << policy << " the data file after sync() holds kept = '" << values["kept"]
+                      << "', name = '" << values["name"] << "'\n";
+            ++failures;
+        }
+    }
+    std::filesystem::remove_all(directory);
+    std::cout << "persistence: " << failures << " failed" << std::endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,38 @@
+#!/bin/sh
+# Runs every script in this directory on both engines, from a file and from standard input,
+# and compares what it writes with the .expected file next to it; then builds and runs each
+# C++ test here with $CXX (default c++).
+# Usage: tests/run.sh <path to the foxl binary>
+foxl=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+here=$(cd "$(dirname "$0")" && pwd)
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+failed=0
+for script in "$here"/*.foxl; do
+    name=$(basename "$script" .foxl)
+    for engine in tree vm; do
+        for source in file stdin; do
+            # Scripts run in a scratch directory, which gets their caches and saved variables.
+            rm -rf "$work"/*
+            cp "$script" "$work/$name.foxl"
+            if [ "$source" = file ]; then
+                (cd "$work" && "$foxl" --engine=$engine "$name.foxl") > "$work/output" 2>&1
+            else
+                (cd "$work" && "$foxl" --engine=$engine - < "$name.foxl") > "$work/output" 2>&1
+            fi
+            if ! diff -u "$here/$name.expected" "$work/output"; then
+                echo "FAILED: $name ($engine, $source)"
+                failed=1
+            fi
+        done
+    done
+done
+for test in "$here"/*.cpp; do
+    name=$(basename "$test" .cpp)
+    if ! ${CXX:-c++} -std=c++17 -O1 -pthread -o "$work/$name" "$test" || ! "$work/$name"; then
+        echo "FAILED: $name"
+        failed=1
+    fi
+done
+[ $failed = 0 ] && echo "All tests passed"
+exit $failed